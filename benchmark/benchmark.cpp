@@ -0,0 +1,328 @@
+#include "zipf_corpus.h"
+
+#include "latency_histogram.h"
+#include "process_queries.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+// Набор сценариев нагрузки на корпусе с распределением слов по Ципфу.
+// Параметры: --documents=N --queries=N --batch-size=N --remove-share=X --vocabulary=N --zipf-exponent=X
+// --seed=N --scenarios=a,b,... --output=path. Результаты пишутся в JSON, пригодный для сравнения запусков
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+struct Config {
+    size_t document_count = 10'000;
+    size_t query_count = 10'000;
+    // запросов в одном вызове ProcessQueries
+    size_t batch_size = 1'000;
+    // доля документов, удаляемых в сценарии remove_document
+    double remove_share = 0.1;
+    ZipfCorpus::Options corpus;
+    set<string> scenarios;
+    string output_path;
+};
+
+struct ScenarioResult {
+    string name;
+    size_t operation_count = 0;
+    // запросов или документов в одной операции
+    size_t items_per_operation = 1;
+    chrono::nanoseconds duration{0};
+    LatencyHistogram latencies;
+    chrono::nanoseconds max_latency{0};
+    // пик RSS процесса к концу сценария, включая предыдущие сценарии
+    uint64_t peak_rss_bytes = 0;
+};
+
+uint64_t GetPeakRssBytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss;
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+const vector<string> ALL_SCENARIOS = {
+    "add_document"s,
+    "find_top_documents"s,
+    "find_top_documents_par"s,
+    "find_top_documents_minus"s,
+    "find_top_documents_status"s,
+    "find_top_documents_predicate"s,
+    "find_top_documents_filter"s,
+    "match_document"s,
+    "match_documents"s,
+    "process_queries"s,
+    "remove_document"s,
+};
+
+Config ParseArguments(int argc, char* argv[]) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        const string argument = argv[i];
+        const size_t separator = argument.find('=');
+        if (argument.rfind("--"s, 0) != 0 || separator == string::npos) {
+            throw invalid_argument("Expected --name=value, got "s + argument);
+        }
+        const string name = argument.substr(2, separator - 2);
+        const string value = argument.substr(separator + 1);
+        if (name == "documents"s) {
+            config.document_count = stoull(value);
+        } else if (name == "queries"s) {
+            config.query_count = stoull(value);
+        } else if (name == "batch-size"s) {
+            config.batch_size = max<size_t>(1, stoull(value));
+        } else if (name == "remove-share"s) {
+            config.remove_share = clamp(stod(value), 0.0, 1.0);
+        } else if (name == "vocabulary"s) {
+            config.corpus.vocabulary_size = stoull(value);
+        } else if (name == "zipf-exponent"s) {
+            config.corpus.exponent = stod(value);
+        } else if (name == "seed"s) {
+            config.corpus.seed = stoull(value);
+        } else if (name == "scenarios"s) {
+            istringstream names(value);
+            for (string scenario; getline(names, scenario, ',');) {
+                if (find(ALL_SCENARIOS.begin(), ALL_SCENARIOS.end(), scenario) == ALL_SCENARIOS.end()) {
+                    throw invalid_argument("Unknown scenario "s + scenario);
+                }
+                config.scenarios.insert(scenario);
+            }
+        } else if (name == "output"s) {
+            config.output_path = value;
+        } else {
+            throw invalid_argument("Unknown option "s + name);
+        }
+    }
+    if (config.scenarios.empty()) {
+        config.scenarios.insert(ALL_SCENARIOS.begin(), ALL_SCENARIOS.end());
+    }
+    return config;
+}
+
+// prepare(i) готовит входные данные i-й операции вне замера, operation(input) выполняется под замером
+template <typename Prepare, typename Operation>
+ScenarioResult RunScenario(const string& name, size_t operation_count, Prepare prepare, Operation operation) {
+    ScenarioResult result;
+    result.name = name;
+    result.operation_count = operation_count;
+    for (size_t i = 0; i < operation_count; ++i) {
+        auto input = prepare(i);
+        const Clock::time_point start_time = Clock::now();
+        operation(input);
+        const chrono::nanoseconds latency = Clock::now() - start_time;
+        result.duration += latency;
+        result.latencies.Record(latency);
+        result.max_latency = max(result.max_latency, latency);
+    }
+    result.peak_rss_bytes = GetPeakRssBytes();
+    return result;
+}
+
+// Граница корзины гистограммы может оказаться больше самой долгой операции
+int64_t GetLatencyQuantile(const ScenarioResult& result, double quantile) {
+    return min(result.latencies.GetQuantile(quantile), result.max_latency).count();
+}
+
+double GetThroughput(const ScenarioResult& result) {
+    const double seconds = chrono::duration<double>(result.duration).count();
+    return seconds > 0 ? result.operation_count * result.items_per_operation / seconds : 0.0;
+}
+
+void WriteJson(ostream& output, const Config& config, const vector<ScenarioResult>& results) {
+    output << "{\n  \"config\": {\"documents\": "s << config.document_count << ", \"queries\": "s << config.query_count
+           << ", \"batch_size\": "s << config.batch_size << ", \"remove_share\": "s << config.remove_share
+           << ", \"vocabulary\": "s << config.corpus.vocabulary_size << ", \"zipf_exponent\": "s << config.corpus.exponent
+           << ", \"seed\": "s << config.corpus.seed << "},\n  \"scenarios\": [\n"s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ScenarioResult& result = results[i];
+        output << "    {\"name\": \""s << result.name << "\", \"operations\": "s << result.operation_count
+               << ", \"items_per_operation\": "s << result.items_per_operation
+               << ", \"seconds\": "s << chrono::duration<double>(result.duration).count()
+               << ", \"throughput_per_second\": "s << GetThroughput(result)
+               << ", \"latency_ns\": {\"p50\": "s << GetLatencyQuantile(result, 0.5)
+               << ", \"p95\": "s << GetLatencyQuantile(result, 0.95)
+               << ", \"p99\": "s << GetLatencyQuantile(result, 0.99)
+               << ", \"p999\": "s << GetLatencyQuantile(result, 0.999)
+               << ", \"max\": "s << result.max_latency.count() << "}"s
+               << ", \"peak_rss_bytes\": "s << result.peak_rss_bytes << "}"s << (i + 1 < results.size() ? ","s : ""s) << "\n"s;
+    }
+    output << "  ]\n}\n"s;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Config config;
+    try {
+        config = ParseArguments(argc, argv);
+    } catch (const exception& error) {
+        cerr << error.what() << endl;
+        return EXIT_FAILURE;
+    }
+    const auto is_enabled = [&config](const string& scenario) {
+        return config.scenarios.count(scenario) > 0;
+    };
+
+    ZipfCorpus corpus(config.corpus);
+    SearchServer search_server(corpus.GetStopWords());
+    vector<ScenarioResult> results;
+    const auto report = [&results](ScenarioResult result) {
+        cerr << result.name << ": "s << GetThroughput(result) << " per second, p99 "s
+             << GetLatencyQuantile(result, 0.99) / 1000.0 << " us"s << endl;
+        results.push_back(move(result));
+    };
+
+    // корпус строится всегда: остальным сценариям нужен индекс, а время добавления измеряется попутно
+    {
+        struct NewDocumentText {
+            int id;
+            string text;
+            DocumentStatus status;
+            vector<int> ratings;
+        };
+        ScenarioResult result = RunScenario("add_document"s, config.document_count,
+            [&corpus](size_t i) {
+                return NewDocumentText{static_cast<int>(i), corpus.GenerateDocument(), corpus.GenerateStatus(), corpus.GenerateRatings()};
+            },
+            [&search_server](const NewDocumentText& document) {
+                search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            });
+        if (is_enabled(result.name)) {
+            report(move(result));
+        }
+    }
+
+    const auto short_query = [&corpus](size_t) {
+        return corpus.GenerateQuery(corpus.GenerateIndex(1, 5), 0);
+    };
+    const auto minus_query = [&corpus](size_t) {
+        return corpus.GenerateQuery(corpus.GenerateIndex(1, 5), corpus.GenerateIndex(1, 2));
+    };
+    if (is_enabled("find_top_documents"s)) {
+        report(RunScenario("find_top_documents"s, config.query_count, short_query, [&search_server](const string& query) {
+            search_server.FindTopDocuments(query);
+        }));
+    }
+    if (is_enabled("find_top_documents_par"s)) {
+        report(RunScenario("find_top_documents_par"s, config.query_count, short_query, [&search_server](const string& query) {
+            search_server.FindTopDocuments(execution::par, query);
+        }));
+    }
+    if (is_enabled("find_top_documents_minus"s)) {
+        report(RunScenario("find_top_documents_minus"s, config.query_count, minus_query, [&search_server](const string& query) {
+            search_server.FindTopDocuments(query);
+        }));
+    }
+    if (is_enabled("find_top_documents_status"s)) {
+        report(RunScenario("find_top_documents_status"s, config.query_count, short_query, [&search_server](const string& query) {
+            search_server.FindTopDocuments(query, DocumentStatus::IRRELEVANT);
+        }));
+    }
+    if (is_enabled("find_top_documents_predicate"s)) {
+        report(RunScenario("find_top_documents_predicate"s, config.query_count, short_query, [&search_server](const string& query) {
+            search_server.FindTopDocuments(query, [](int, DocumentStatus status, int rating) {
+                return status == DocumentStatus::ACTUAL && rating > 2;
+            });
+        }));
+    }
+    if (is_enabled("find_top_documents_filter"s)) {
+        // тот же отбор, что и в find_top_documents_predicate, но фильтром, который проверяется по колонкам
+        report(RunScenario("find_top_documents_filter"s, config.query_count, short_query, [&search_server](const string& query) {
+            search_server.FindTopDocuments(query, DocumentFilter{DocumentStatus::ACTUAL, 3});
+        }));
+    }
+    if (is_enabled("match_document"s) && config.document_count > 0) {
+        report(RunScenario("match_document"s, config.query_count,
+            [&](size_t i) {
+                return pair{minus_query(i), static_cast<int>(corpus.GenerateIndex(0, config.document_count - 1))};
+            },
+            [&search_server](const pair<string, int>& request) {
+                search_server.MatchDocument(request.first, request.second);
+            }));
+    }
+    if (is_enabled("match_documents"s) && config.document_count > 0) {
+        ScenarioResult result = RunScenario("match_documents"s, (config.query_count + config.batch_size - 1) / config.batch_size,
+            [&](size_t i) {
+                vector<int> document_ids(config.batch_size);
+                for (int& document_id : document_ids) {
+                    document_id = static_cast<int>(corpus.GenerateIndex(0, config.document_count - 1));
+                }
+                return pair{minus_query(i), document_ids};
+            },
+            [&search_server](const pair<string, vector<int>>& request) {
+                search_server.MatchDocuments(request.first, request.second);
+            });
+        result.items_per_operation = config.batch_size;
+        report(move(result));
+    }
+    if (is_enabled("process_queries"s)) {
+        ScenarioResult result = RunScenario("process_queries"s, (config.query_count + config.batch_size - 1) / config.batch_size,
+            [&](size_t) {
+                vector<string> queries(config.batch_size);
+                for (string& query : queries) {
+                    query = minus_query(0);
+                }
+                return queries;
+            },
+            [&search_server](const vector<string>& queries) {
+                ProcessQueries(search_server, queries);
+            });
+        result.items_per_operation = config.batch_size;
+        report(move(result));
+    }
+    // удаление меняет индекс, поэтому выполняется последним
+    if (is_enabled("remove_document"s)) {
+        vector<int> document_ids(config.document_count);
+        for (size_t i = 0; i < document_ids.size(); ++i) {
+            document_ids[i] = static_cast<int>(i);
+        }
+        for (size_t i = 0; i + 1 < document_ids.size(); ++i) {
+            swap(document_ids[i], document_ids[corpus.GenerateIndex(i, document_ids.size() - 1)]);
+        }
+        report(RunScenario("remove_document"s, static_cast<size_t>(document_ids.size() * config.remove_share),
+            [&document_ids](size_t i) {
+                return document_ids[i];
+            },
+            [&search_server](int document_id) {
+                search_server.RemoveDocument(document_id);
+            }));
+    }
+
+    if (config.output_path.empty()) {
+        WriteJson(cout, config, results);
+    } else {
+        ofstream output(config.output_path);
+        WriteJson(output, config, results);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include "zipf_corpus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// Биективная запись числа в 26-ричной системе буквами: 1 - "a", 26 - "z", 27 - "aa"
+string MakeWord(size_t number) {
+    string word;
+    for (; number > 0; number = (number - 1) / 26) {
+        word.push_back(static_cast<char>('a' + (number - 1) % 26));
+    }
+    reverse(word.begin(), word.end());
+    return word;
+}
+
+} // namespace
+
+ZipfCorpus::ZipfCorpus(const Options& options)
+    : options_(options)
+    , generator_(options.seed) {
+    if (options_.vocabulary_size <= options_.stop_word_count || options_.min_document_words == 0
+        || options_.min_document_words > options_.max_document_words) {
+        throw invalid_argument("Invalid corpus options"s);
+    }
+    words_.reserve(options_.vocabulary_size);
+    cumulative_weights_.reserve(options_.vocabulary_size);
+    double total_weight = 0.0;
+    for (size_t rank = 0; rank < options_.vocabulary_size; ++rank) {
+        words_.push_back(MakeWord(rank + 1));
+        total_weight += 1.0 / pow(rank + 1, options_.exponent);
+        cumulative_weights_.push_back(total_weight);
+    }
+}
+
+const string& ZipfCorpus::GetWord(size_t rank) const {
+    return words_.at(rank);
+}
+
+vector<string> ZipfCorpus::GetStopWords() const {
+    return {words_.begin(), words_.begin() + options_.stop_word_count};
+}
+
+string ZipfCorpus::GenerateDocument() {
+    const size_t word_count = GenerateIndex(options_.min_document_words, options_.max_document_words);
+    string document;
+    for (size_t i = 0; i < word_count; ++i) {
+        if (i > 0) {
+            document.push_back(' ');
+        }
+        document += words_[SampleRank()];
+    }
+    return document;
+}
+
+string ZipfCorpus::GenerateQuery(size_t plus_word_count, size_t minus_word_count) {
+    string query;
+    for (size_t i = 0; i < plus_word_count + minus_word_count; ++i) {
+        if (i > 0) {
+            query.push_back(' ');
+        }
+        if (i >= plus_word_count) {
+            query.push_back('-');
+        }
+        query += words_[SampleQueryRank()];
+    }
+    return query;
+}
+
+DocumentStatus ZipfCorpus::GenerateStatus() {
+    const size_t value = GenerateIndex(0, 99);
+    if (value < 85) {
+        return DocumentStatus::ACTUAL;
+    }
+    return value < 95 ? DocumentStatus::IRRELEVANT : DocumentStatus::BANNED;
+}
+
+vector<int> ZipfCorpus::GenerateRatings() {
+    vector<int> ratings(GenerateIndex(1, 5));
+    for (int& rating : ratings) {
+        rating = static_cast<int>(GenerateIndex(0, 20)) - 5;
+    }
+    return ratings;
+}
+
+size_t ZipfCorpus::GenerateIndex(size_t first, size_t last) {
+    return uniform_int_distribution<size_t>(first, last)(generator_);
+}
+
+size_t ZipfCorpus::SampleRank() {
+    const double value = uniform_real_distribution<double>(0.0, cumulative_weights_.back())(generator_);
+    const size_t rank = upper_bound(cumulative_weights_.begin(), cumulative_weights_.end(), value) - cumulative_weights_.begin();
+    return min(rank, words_.size() - 1);
+}
+
+size_t ZipfCorpus::SampleQueryRank() {
+    size_t rank = SampleRank();
+    while (rank < options_.stop_word_count) {
+        rank = SampleRank();
+    }
+    return rank;
+}
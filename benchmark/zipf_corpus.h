@@ -0,0 +1,54 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Генератор текстов, в которых слово ранга r встречается с частотой, пропорциональной 1 / r^exponent,
+// как в естественных текстах: немногие частые слова дают длинные списки постингов, остальные - короткие
+class ZipfCorpus {
+public:
+    struct Options {
+        size_t vocabulary_size = 100'000;
+        double exponent = 1.0;
+        size_t min_document_words = 20;
+        size_t max_document_words = 120;
+        // самые частые слова объявляются стоп-словами
+        size_t stop_word_count = 10;
+        uint64_t seed = 42;
+    };
+
+    explicit ZipfCorpus(const Options& options);
+
+    // Частые слова короче редких; разным рангам соответствуют разные слова
+    const std::string& GetWord(size_t rank) const;
+
+    std::vector<std::string> GetStopWords() const;
+
+    std::string GenerateDocument();
+
+    // Слова запроса тоже распределены по Ципфу, но стоп-слов среди них нет
+    std::string GenerateQuery(size_t plus_word_count, size_t minus_word_count);
+
+    // В основном ACTUAL, немного IRRELEVANT и BANNED
+    DocumentStatus GenerateStatus();
+
+    std::vector<int> GenerateRatings();
+
+    // Равномерно распределённое число из [first, last]
+    size_t GenerateIndex(size_t first, size_t last);
+
+private:
+    Options options_;
+    std::vector<std::string> words_;
+    std::vector<double> cumulative_weights_;
+    std::mt19937_64 generator_;
+
+    size_t SampleRank();
+
+    size_t SampleQueryRank();
+};
@@ -0,0 +1,49 @@
+#include "admission_queue.h"
+
+using namespace std;
+
+AdmissionQueue::AdmissionQueue(size_t capacity)
+    : capacity_(capacity) {
+}
+
+void AdmissionQueue::SetCapacity(size_t capacity) {
+    {
+        lock_guard lock(mutex_);
+        capacity_ = capacity;
+    }
+    released_.notify_all();
+}
+
+bool AdmissionQueue::Acquire(chrono::steady_clock::time_point deadline) {
+    unique_lock lock(mutex_);
+    const auto has_place = [this] {
+        return pending_count_ < capacity_;
+    };
+    // ожидание до time_point::max() переполняет перевод срока в системные часы
+    if (deadline == chrono::steady_clock::time_point::max()) {
+        released_.wait(lock, has_place);
+    } else if (!released_.wait_until(lock, deadline, has_place)) {
+        ++rejected_count_;
+        return false;
+    }
+    ++pending_count_;
+    return true;
+}
+
+void AdmissionQueue::Release() {
+    {
+        lock_guard lock(mutex_);
+        --pending_count_;
+    }
+    released_.notify_one();
+}
+
+size_t AdmissionQueue::GetPendingCount() const {
+    lock_guard lock(mutex_);
+    return pending_count_;
+}
+
+uint64_t AdmissionQueue::GetRejectedCount() const {
+    lock_guard lock(mutex_);
+    return rejected_count_;
+}
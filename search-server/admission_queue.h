@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Ограничивает число принятых, но ещё не выполненных запросов. Когда мест нет, новый запрос
+// ждёт освобождения места, поэтому отправитель сам замедляется вместо роста очереди
+class AdmissionQueue {
+public:
+    explicit AdmissionQueue(size_t capacity);
+
+    AdmissionQueue(const AdmissionQueue&) = delete;
+    AdmissionQueue& operator=(const AdmissionQueue&) = delete;
+
+    // Уже принятые запросы не вытесняются, даже если их больше новой ёмкости
+    void SetCapacity(size_t capacity);
+
+    // Занимает место, ожидая его не дольше deadline; false - место так и не освободилось
+    bool Acquire(std::chrono::steady_clock::time_point deadline);
+
+    void Release();
+
+    size_t GetPendingCount() const;
+
+    // Запросы, не дождавшиеся места до своего срока
+    uint64_t GetRejectedCount() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    size_t capacity_;
+    size_t pending_count_ = 0;
+    uint64_t rejected_count_ = 0;
+};
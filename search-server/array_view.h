@@ -0,0 +1,97 @@
+#pragma once
+
+#include "memory_usage.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Непрерывный участок чужого массива
+template <typename T>
+class ArrayView {
+public:
+    ArrayView() = default;
+
+    ArrayView(const T* first, const T* last) : first_(first), last_(last) {
+    }
+
+    const T* begin() const {
+        return first_;
+    }
+
+    const T* end() const {
+        return last_;
+    }
+
+    size_t size() const {
+        return last_ - first_;
+    }
+
+    bool empty() const {
+        return first_ == last_;
+    }
+
+    const T& operator[](size_t index) const {
+        return first_[index];
+    }
+
+private:
+    const T* first_ = nullptr;
+    const T* last_ = nullptr;
+};
+
+// Массив, первые элементы которого могут лежать в отображённом в память файле снимка,
+// а добавленные после загрузки - в обычном векторе
+template <typename T>
+class MappedVector {
+public:
+    void Attach(T* base, size_t base_size) {
+        base_ = base;
+        base_size_ = base_size;
+        tail_.clear();
+    }
+
+    T& operator[](size_t index) {
+        return index < base_size_ ? base_[index] : tail_[index - base_size_];
+    }
+
+    const T& operator[](size_t index) const {
+        return index < base_size_ ? base_[index] : tail_[index - base_size_];
+    }
+
+    size_t size() const {
+        return base_size_ + tail_.size();
+    }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        return tail_.emplace_back(std::forward<Args>(args)...);
+    }
+
+    void push_back(const T& value) {
+        tail_.push_back(value);
+    }
+
+    // Элементы из снимка и добавленные после загрузки: для горячих циклов, которым дорога проверка в operator[]
+    const T* GetBase() const {
+        return base_;
+    }
+
+    size_t GetBaseSize() const {
+        return base_size_;
+    }
+
+    const T* GetTail() const {
+        return tail_.data();
+    }
+
+    // Элементы из снимка лежат в отображённом файле, а не в куче
+    size_t GetMemoryUsage() const {
+        return GetHeapSize(tail_);
+    }
+
+private:
+    T* base_ = nullptr;
+    size_t base_size_ = 0;
+    std::vector<T> tail_;
+};
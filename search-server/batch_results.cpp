@@ -0,0 +1,22 @@
+#include "batch_results.h"
+
+#include <utility>
+
+using namespace std;
+
+BatchResults::BatchResults(vector<Document> documents, vector<size_t> offsets)
+    : documents_(move(documents))
+    , offsets_(move(offsets)) {
+}
+
+size_t BatchResults::size() const {
+    return offsets_.size() - 1;
+}
+
+ArrayView<Document> BatchResults::operator[](size_t query) const {
+    return {documents_.data() + offsets_[query], documents_.data() + offsets_[query + 1]};
+}
+
+const vector<Document>& BatchResults::GetDocuments() const {
+    return documents_;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "array_view.h"
+#include "document.h"
+
+#include <cstddef>
+#include <vector>
+
+// Результаты пакета запросов в одном непрерывном буфере: документы i-го запроса
+// занимают участок [offsets[i], offsets[i + 1])
+class BatchResults {
+public:
+    BatchResults() = default;
+
+    BatchResults(std::vector<Document> documents, std::vector<size_t> offsets);
+
+    // Количество запросов
+    size_t size() const;
+
+    ArrayView<Document> operator[](size_t query) const;
+
+    // Документы всех запросов подряд в порядке запросов
+    const std::vector<Document>& GetDocuments() const;
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_ = {0};
+};
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document() = default;
@@ -21,4 +26,30 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// Фильтр по статусу и диапазону среднего рейтинга [min_rating, max_rating]; status = nullopt - любой статус.
+// В отличие от произвольного предиката сервер проверяет его по колонкам индекса прямо при обходе постингов
+struct DocumentFilter {
+    std::optional<DocumentStatus> status = DocumentStatus::ACTUAL;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+};
+
+// Внутренний номер документа: отсутствует или не попадает в снимок
+const uint32_t NO_ORDINAL = std::numeric_limits<uint32_t>::max();
+
+// Документ для пакетного добавления через SearchServer::AddDocuments
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
+// Результат поиска со сроком выполнения
+struct FindResult {
+    std::vector<Document> documents;
+    // поиск остановлен по сроку: documents - лучшие среди просмотренных документов
+    bool is_truncated = false;
+};
+
 
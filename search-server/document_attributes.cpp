@@ -0,0 +1,102 @@
+#include "document_attributes.h"
+#include "memory_usage.h"
+
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+void DocumentAttributes::AddDocument(DocumentStatus status, int rating) {
+    const size_t ordinal = ratings_.size();
+    if (ordinal % 64 == 0) {
+        for (auto& bitmap : status_bitmaps_) {
+            bitmap.push_back(0);
+        }
+    }
+    const uint64_t bit = uint64_t{1} << (ordinal % 64);
+    status_bitmaps_[static_cast<size_t>(status)][ordinal / 64] |= bit;
+    status_bitmaps_[STATUS_COUNT][ordinal / 64] |= bit;
+    ratings_.push_back(rating);
+}
+
+void DocumentAttributes::RemoveDocument(uint32_t ordinal) {
+    const uint64_t mask = ~(uint64_t{1} << (ordinal % 64));
+    for (auto& bitmap : status_bitmaps_) {
+        bitmap[ordinal / 64] &= mask;
+    }
+}
+
+size_t DocumentAttributes::GetMemoryUsage() const {
+    size_t bytes = ratings_.GetMemoryUsage();
+    for (const auto& bitmap : status_bitmaps_) {
+        bytes += bitmap.GetMemoryUsage();
+    }
+    return bytes;
+}
+
+DocumentAttributes::Matcher DocumentAttributes::GetMatcher(const DocumentFilter& filter) const {
+    const auto& bitmap = status_bitmaps_[filter.status ? static_cast<size_t>(*filter.status) : STATUS_COUNT];
+    Matcher matcher;
+    matcher.base_bitmap_ = bitmap.GetBase();
+    matcher.tail_bitmap_ = bitmap.GetTail();
+    matcher.base_word_count_ = bitmap.GetBaseSize();
+    matcher.base_ratings_ = ratings_.GetBase();
+    matcher.tail_ratings_ = ratings_.GetTail();
+    matcher.base_rating_count_ = ratings_.GetBaseSize();
+    matcher.min_rating_ = filter.min_rating;
+    matcher.max_rating_ = filter.max_rating;
+    matcher.has_rating_range_ = filter.min_rating != numeric_limits<int>::min() || filter.max_rating != numeric_limits<int>::max();
+    return matcher;
+}
+
+void DocumentAttributes::Save(SnapshotWriter& writer) const {
+    vector<int> ratings(ratings_.size());
+    for (size_t ordinal = 0; ordinal < ratings.size(); ++ordinal) {
+        ratings[ordinal] = ratings_[ordinal];
+    }
+    // карты подряд, каждая по (число документов + 63) / 64 слов
+    vector<uint64_t> bitmaps;
+    for (const auto& bitmap : status_bitmaps_) {
+        for (size_t word = 0; word < bitmap.size(); ++word) {
+            bitmaps.push_back(bitmap[word]);
+        }
+    }
+    writer.WriteSection(SnapshotSection::DOCUMENT_RATINGS, ratings);
+    writer.WriteSection(SnapshotSection::DOCUMENT_STATUS_BITMAPS, bitmaps);
+}
+
+void DocumentAttributes::Load(const SnapshotReader& reader, size_t document_count) {
+    const auto [ratings, rating_count] = reader.GetSection<int>(SnapshotSection::DOCUMENT_RATINGS);
+    const auto [bitmaps, bitmap_word_count] = reader.GetSection<uint64_t>(SnapshotSection::DOCUMENT_STATUS_BITMAPS);
+    const size_t word_count = (document_count + 63) / 64;
+    if (rating_count != document_count || bitmap_word_count != (STATUS_COUNT + 1) * word_count) {
+        throw invalid_argument("Snapshot document attributes are corrupted"s);
+    }
+    ratings_.Attach(ratings, rating_count);
+    for (size_t status = 0; status <= STATUS_COUNT; ++status) {
+        status_bitmaps_[status].Attach(bitmaps + status * word_count, word_count);
+    }
+}
+
+void DocumentAttributes::Validate(const SnapshotReader& reader, size_t document_count) {
+    const auto [bitmaps, bitmap_word_count] = reader.GetSection<uint64_t>(SnapshotSection::DOCUMENT_STATUS_BITMAPS);
+    const size_t word_count = (document_count + 63) / 64;
+    if (bitmap_word_count != (STATUS_COUNT + 1) * word_count) {
+        throw invalid_argument("Snapshot document attributes are corrupted"s);
+    }
+    for (size_t word = 0; word < word_count; ++word) {
+        const uint64_t used_bits = word + 1 < word_count || document_count % 64 == 0 ? ~uint64_t{0} : (uint64_t{1} << (document_count % 64)) - 1;
+        uint64_t any_status = 0;
+        for (size_t status = 0; status < STATUS_COUNT; ++status) {
+            const uint64_t bits = bitmaps[status * word_count + word];
+            if ((bits & any_status) != 0) {
+                throw invalid_argument("Snapshot document attributes are corrupted"s);
+            }
+            any_status |= bits;
+        }
+        // в снимке нет удалённых документов
+        if (any_status != used_bits || bitmaps[STATUS_COUNT * word_count + word] != used_bits) {
+            throw invalid_argument("Snapshot document attributes are corrupted"s);
+        }
+    }
+}
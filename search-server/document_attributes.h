@@ -0,0 +1,78 @@
+#pragma once
+
+#include "array_view.h"
+#include "document.h"
+#include "snapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Атрибуты документов колонками по внутренним номерам: рейтинги подряд в массиве, статусы - битовыми
+// картами, по одной на статус и ещё одна для всех документов. Удалённый документ снимается со всех карт,
+// поэтому проверка статуса по карте заодно отсекает удалённые документы. Колонки документов из снимка
+// лежат в отображённом файле, добавленные после загрузки - в памяти
+class DocumentAttributes {
+public:
+    // Фильтр, подготовленный к проверке: карта статуса выбирается один раз на запрос,
+    // а колонка рейтингов читается, только если диапазон рейтинга ограничен
+    class Matcher {
+    public:
+        bool operator()(uint32_t ordinal) const;
+
+    private:
+        friend class DocumentAttributes;
+
+        // слова карты и рейтинги из снимка и добавленные после загрузки
+        const uint64_t* base_bitmap_ = nullptr;
+        const uint64_t* tail_bitmap_ = nullptr;
+        size_t base_word_count_ = 0;
+        const int* base_ratings_ = nullptr;
+        const int* tail_ratings_ = nullptr;
+        size_t base_rating_count_ = 0;
+        int min_rating_ = 0;
+        int max_rating_ = 0;
+        bool has_rating_range_ = false;
+    };
+
+    // Документы добавляются по порядку номеров
+    void AddDocument(DocumentStatus status, int rating);
+
+    void RemoveDocument(uint32_t ordinal);
+
+    // Память в куче со служебными данными распределителя; колонки из снимка в неё не входят
+    size_t GetMemoryUsage() const;
+
+    // Действует, пока атрибуты не меняются
+    Matcher GetMatcher(const DocumentFilter& filter) const;
+
+    void Save(SnapshotWriter& writer) const;
+
+    // Карты статусов меняются на месте, поэтому у каждой копии индекса должно быть своё отображение файла
+    void Load(const SnapshotReader& reader, size_t document_count);
+
+    // Проверяет колонки снимка, загруженного без проверки контрольных сумм: у каждого документа
+    // ровно один статус, и за последним документом битов нет
+    static void Validate(const SnapshotReader& reader, size_t document_count);
+
+private:
+    static const size_t STATUS_COUNT = 4;
+
+    // status_bitmaps_[STATUS_COUNT] - все документы, не считая удалённых
+    MappedVector<uint64_t> status_bitmaps_[STATUS_COUNT + 1];
+    MappedVector<int> ratings_;
+};
+
+
+inline bool DocumentAttributes::Matcher::operator()(uint32_t ordinal) const {
+    const size_t word = ordinal / 64;
+    const uint64_t bits = word < base_word_count_ ? base_bitmap_[word] : tail_bitmap_[word - base_word_count_];
+    if ((bits >> (ordinal % 64) & 1) == 0) {
+        return false;
+    }
+    if (!has_rating_range_) {
+        return true;
+    }
+    const int rating = ordinal < base_rating_count_ ? base_ratings_[ordinal] : tail_ratings_[ordinal - base_rating_count_];
+    return rating >= min_rating_ && rating <= max_rating_;
+}
@@ -0,0 +1,139 @@
+#include "document_id_index.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+DocumentIdIndex::Iterator::Iterator(const DocumentIdIndex* index, size_t base_pos, map<int, uint32_t>::const_iterator tail_it)
+    : index_(index)
+    , base_pos_(base_pos)
+    , tail_it_(tail_it) {
+    SkipRemoved();
+}
+
+DocumentIdIndex::Iterator::reference DocumentIdIndex::Iterator::operator*() const {
+    return IsBaseCurrent() ? index_->base_[base_pos_].id : tail_it_->first;
+}
+
+DocumentIdIndex::Iterator& DocumentIdIndex::Iterator::operator++() {
+    if (IsBaseCurrent()) {
+        ++base_pos_;
+        SkipRemoved();
+    } else {
+        ++tail_it_;
+    }
+    return *this;
+}
+
+DocumentIdIndex::Iterator DocumentIdIndex::Iterator::operator++(int) {
+    Iterator result = *this;
+    ++*this;
+    return result;
+}
+
+bool DocumentIdIndex::Iterator::operator==(const Iterator& other) const {
+    return base_pos_ == other.base_pos_ && tail_it_ == other.tail_it_;
+}
+
+bool DocumentIdIndex::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+void DocumentIdIndex::Iterator::SkipRemoved() {
+    while (base_pos_ < index_->base_size_ && index_->base_removed_[base_pos_]) {
+        ++base_pos_;
+    }
+}
+
+bool DocumentIdIndex::Iterator::IsBaseCurrent() const {
+    if (base_pos_ == index_->base_size_) {
+        return false;
+    }
+    return tail_it_ == index_->tail_.end() || index_->base_[base_pos_].id < tail_it_->first;
+}
+
+
+bool DocumentIdIndex::Insert(int id, uint32_t ordinal) {
+    if (Find(id) != NO_ORDINAL) {
+        return false;
+    }
+    tail_.emplace(id, ordinal);
+    return true;
+}
+
+uint32_t DocumentIdIndex::Find(int id) const {
+    if (const size_t pos = FindInBase(id); pos != base_size_) {
+        return base_[pos].ordinal;
+    }
+    auto it = tail_.find(id);
+    return it == tail_.end() ? NO_ORDINAL : it->second;
+}
+
+void DocumentIdIndex::Erase(int id) {
+    if (const size_t pos = FindInBase(id); pos != base_size_) {
+        base_removed_[pos] = true;
+        ++base_removed_count_;
+        return;
+    }
+    tail_.erase(id);
+}
+
+size_t DocumentIdIndex::size() const {
+    return base_size_ - base_removed_count_ + tail_.size();
+}
+
+size_t DocumentIdIndex::GetMemoryUsage() const {
+    return GetHeapSize(base_removed_) + tail_.size() * GetTreeNodeSize<pair<const int, uint32_t>>();
+}
+
+DocumentIdIndex::Iterator DocumentIdIndex::begin() const {
+    return {this, 0, tail_.begin()};
+}
+
+DocumentIdIndex::Iterator DocumentIdIndex::end() const {
+    return {this, base_size_, tail_.end()};
+}
+
+void DocumentIdIndex::Save(SnapshotWriter& writer, const vector<uint32_t>& new_ordinals) const {
+    vector<DocumentIdEntry> entries;
+    entries.reserve(size());
+    for (const int id : *this) {
+        entries.push_back({id, new_ordinals[Find(id)]});
+    }
+    writer.WriteSection(SnapshotSection::DOCUMENT_IDS, entries);
+}
+
+void DocumentIdIndex::Load(const SnapshotReader& reader) {
+    const auto [entries, entry_count] = reader.GetSection<DocumentIdEntry>(SnapshotSection::DOCUMENT_IDS);
+    base_ = entries;
+    base_size_ = entry_count;
+    base_removed_.assign(entry_count, false);
+    base_removed_count_ = 0;
+    tail_.clear();
+}
+
+void DocumentIdIndex::Validate(const SnapshotReader& reader, size_t document_count) {
+    const auto [entries, entry_count] = reader.GetSection<DocumentIdEntry>(SnapshotSection::DOCUMENT_IDS);
+    if (entry_count != document_count) {
+        throw invalid_argument("Snapshot document ids are corrupted"s);
+    }
+    vector<bool> is_used(document_count);
+    for (size_t i = 0; i < entry_count; ++i) {
+        if ((i > 0 && entries[i].id <= entries[i - 1].id) || entries[i].ordinal >= document_count || is_used[entries[i].ordinal]) {
+            throw invalid_argument("Snapshot document ids are corrupted"s);
+        }
+        is_used[entries[i].ordinal] = true;
+    }
+}
+
+size_t DocumentIdIndex::FindInBase(int id) const {
+    const DocumentIdEntry* it = lower_bound(base_, base_ + base_size_, id, [](const DocumentIdEntry& entry, int value) {
+        return entry.id < value;
+    });
+    if (it == base_ + base_size_ || it->id != id || base_removed_[it - base_]) {
+        return base_size_;
+    }
+    return it - base_;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "document.h"
+#include "snapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+struct DocumentIdEntry {
+    int id;
+    uint32_t ordinal;
+};
+
+// Соответствие внешних id документов их внутренним номерам с обходом id по возрастанию.
+// Документы из снимка ищутся двоичным поиском в отображённом файле, новые хранятся в std::map
+class DocumentIdIndex {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const int*;
+        using reference = const int&;
+
+        Iterator(const DocumentIdIndex* index, size_t base_pos, std::map<int, uint32_t>::const_iterator tail_it);
+
+        reference operator*() const;
+
+        Iterator& operator++();
+
+        Iterator operator++(int);
+
+        bool operator==(const Iterator& other) const;
+
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        const DocumentIdIndex* index_;
+        size_t base_pos_;
+        std::map<int, uint32_t>::const_iterator tail_it_;
+
+        void SkipRemoved();
+        bool IsBaseCurrent() const;
+    };
+
+    // false, если такой id уже есть
+    bool Insert(int id, uint32_t ordinal);
+
+    // NO_ORDINAL, если документа нет
+    uint32_t Find(int id) const;
+
+    void Erase(int id);
+
+    size_t size() const;
+
+    // Память в куче со служебными данными распределителя; id из снимка в неё не входят
+    size_t GetMemoryUsage() const;
+
+    Iterator begin() const;
+
+    Iterator end() const;
+
+    void Save(SnapshotWriter& writer, const std::vector<uint32_t>& new_ordinals) const;
+
+    void Load(const SnapshotReader& reader);
+
+    // Проверяет id снимка, загруженного без проверки контрольных сумм: у каждого документа свой номер
+    static void Validate(const SnapshotReader& reader, size_t document_count);
+
+private:
+    const DocumentIdEntry* base_ = nullptr;
+    size_t base_size_ = 0;
+    std::vector<bool> base_removed_;
+    size_t base_removed_count_ = 0;
+    std::map<int, uint32_t> tail_;
+
+    size_t FindInBase(int id) const;
+};
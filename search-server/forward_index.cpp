@@ -0,0 +1,122 @@
+#include "forward_index.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+void ForwardIndex::AddDocument(const unordered_map<TermId, double>& term_freqs) {
+    const size_t first_term = terms_.size();
+    for (const auto& [term, _] : term_freqs) {
+        terms_.push_back(term);
+    }
+    sort(terms_.begin() + first_term, terms_.end());
+    offsets_.push_back(terms_.size());
+    fingerprints_.push_back(ComputeChecksum(reinterpret_cast<const char*>(terms_.data() + first_term), (terms_.size() - first_term) * sizeof(TermId)));
+    cleared_.push_back(false);
+}
+
+ArrayView<TermId> ForwardIndex::GetTerms(uint32_t ordinal) const {
+    if (ordinal < base_document_count_) {
+        return {base_terms_ + base_offsets_[ordinal], base_terms_ + base_offsets_[ordinal + 1]};
+    }
+    const size_t document = ordinal - base_document_count_;
+    return {terms_.data() + offsets_[document], terms_.data() + offsets_[document + 1]};
+}
+
+uint64_t ForwardIndex::GetFingerprint(uint32_t ordinal) const {
+    if (ordinal < base_document_count_) {
+        return base_fingerprints_[ordinal];
+    }
+    return fingerprints_[ordinal - base_document_count_];
+}
+
+void ForwardIndex::ClearDocument(uint32_t ordinal) {
+    if (ordinal < base_document_count_ || cleared_[ordinal - base_document_count_]) {
+        return;
+    }
+    const size_t document = ordinal - base_document_count_;
+    cleared_[document] = true;
+    cleared_term_count_ += offsets_[document + 1] - offsets_[document];
+    if (cleared_term_count_ * COMPACTION_REMOVED_SHARE >= terms_.size()) {
+        Compact();
+    }
+}
+
+void ForwardIndex::Compact() {
+    size_t kept_count = 0;
+    for (size_t document = 0; document < fingerprints_.size(); ++document) {
+        const size_t first = offsets_[document];
+        const size_t last = offsets_[document + 1];
+        offsets_[document] = kept_count;
+        if (!cleared_[document]) {
+            copy(terms_.begin() + first, terms_.begin() + last, terms_.begin() + kept_count);
+            kept_count += last - first;
+        }
+    }
+    offsets_.back() = kept_count;
+    terms_.resize(kept_count);
+    terms_.shrink_to_fit();
+    cleared_term_count_ = 0;
+}
+
+size_t ForwardIndex::GetMemoryUsage() const {
+    return GetHeapSize(offsets_) + GetHeapSize(terms_) + GetHeapSize(fingerprints_) + GetHeapSize(cleared_);
+}
+
+void ForwardIndex::Save(SnapshotWriter& writer, const vector<uint32_t>& new_ordinals) const {
+    vector<uint64_t> offsets{0};
+    vector<TermId> terms;
+    vector<uint64_t> fingerprints;
+    for (uint32_t ordinal = 0; ordinal < new_ordinals.size(); ++ordinal) {
+        if (new_ordinals[ordinal] == NO_ORDINAL) {
+            continue;
+        }
+        const ArrayView<TermId> document_terms = GetTerms(ordinal);
+        terms.insert(terms.end(), document_terms.begin(), document_terms.end());
+        offsets.push_back(terms.size());
+        fingerprints.push_back(GetFingerprint(ordinal));
+    }
+    writer.WriteSection(SnapshotSection::FORWARD_OFFSETS, offsets);
+    writer.WriteSection(SnapshotSection::FORWARD_TERMS, terms);
+    writer.WriteSection(SnapshotSection::FORWARD_FINGERPRINTS, fingerprints);
+}
+
+void ForwardIndex::Load(const SnapshotReader& reader) {
+    const auto [offsets, offset_count] = reader.GetSection<uint64_t>(SnapshotSection::FORWARD_OFFSETS);
+    const auto [terms, term_count] = reader.GetSection<TermId>(SnapshotSection::FORWARD_TERMS);
+    const auto [fingerprints, fingerprint_count] = reader.GetSection<uint64_t>(SnapshotSection::FORWARD_FINGERPRINTS);
+    if (offset_count == 0 || offsets[offset_count - 1] != term_count || fingerprint_count != offset_count - 1) {
+        throw invalid_argument("Snapshot forward index is corrupted"s);
+    }
+    base_offsets_ = offsets;
+    base_terms_ = terms;
+    base_fingerprints_ = fingerprints;
+    base_document_count_ = offset_count - 1;
+    offsets_.assign(1, 0);
+    terms_.clear();
+    fingerprints_.clear();
+    cleared_.clear();
+    cleared_term_count_ = 0;
+}
+
+void ForwardIndex::Validate(const SnapshotReader& reader, size_t document_count, size_t term_count) {
+    const auto [offsets, offset_count] = reader.GetSection<uint64_t>(SnapshotSection::FORWARD_OFFSETS);
+    const auto [terms, document_term_count] = reader.GetSection<TermId>(SnapshotSection::FORWARD_TERMS);
+    if (offset_count != document_count + 1 || offsets[0] != 0 || offsets[document_count] != document_term_count) {
+        throw invalid_argument("Snapshot forward index is corrupted"s);
+    }
+    for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        if (offsets[ordinal] > offsets[ordinal + 1]) {
+            throw invalid_argument("Snapshot forward index is corrupted"s);
+        }
+        // слова документа различны и идут по возрастанию
+        for (size_t i = offsets[ordinal]; i < offsets[ordinal + 1]; ++i) {
+            if (terms[i] >= term_count || (i > offsets[ordinal] && terms[i] <= terms[i - 1])) {
+                throw invalid_argument("Snapshot forward index is corrupted"s);
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "array_view.h"
+#include "document.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Прямой индекс: внутренний номер документа -> его слова. Номера слов всех документов лежат подряд
+// в одном массиве, у документа они отсортированы, чтобы их можно было пересекать с запросом блоками.
+// Частоты слов здесь не хранятся: они есть в постингах, а нужны только GetWordFrequencies.
+// Документы из снимка читаются из отображённого файла, добавленные после загрузки хранятся в памяти
+class ForwardIndex {
+public:
+    // Документы добавляются по порядку номеров
+    void AddDocument(const std::unordered_map<TermId, double>& term_freqs);
+
+    // Номера слов документа по возрастанию
+    ArrayView<TermId> GetTerms(uint32_t ordinal) const;
+
+    // Хеш набора слов документа без учёта частот: у документов с одинаковыми наборами слов
+    // отпечатки совпадают. Считается при добавлении, а не при каждом поиске дубликатов
+    uint64_t GetFingerprint(uint32_t ordinal) const;
+
+    // Слова удалённого документа, добавленного после загрузки, выбрасываются из массива при уплотнении
+    void ClearDocument(uint32_t ordinal);
+
+    // Память в куче со служебными данными распределителя; документы из снимка в неё не входят
+    size_t GetMemoryUsage() const;
+
+    void Save(SnapshotWriter& writer, const std::vector<uint32_t>& new_ordinals) const;
+
+    void Load(const SnapshotReader& reader);
+
+    // Проверяет слова документов снимка, загруженного без проверки контрольных сумм
+    static void Validate(const SnapshotReader& reader, size_t document_count, size_t term_count);
+
+private:
+    // уплотнение запускается, когда слова удалённых документов составляют не меньше 1/COMPACTION_REMOVED_SHARE массива
+    static const size_t COMPACTION_REMOVED_SHARE = 4;
+
+    const uint64_t* base_offsets_ = nullptr;
+    const TermId* base_terms_ = nullptr;
+    const uint64_t* base_fingerprints_ = nullptr;
+    size_t base_document_count_ = 0;
+    // Документы, добавленные после загрузки: слова документа i - terms_[offsets_[i]..offsets_[i + 1])
+    std::vector<uint64_t> offsets_{0};
+    std::vector<TermId> terms_;
+    std::vector<uint64_t> fingerprints_;
+    std::vector<bool> cleared_;
+    // слова удалённых документов, ещё лежащие в terms_
+    size_t cleared_term_count_ = 0;
+
+    // Выбрасывает из terms_ слова удалённых документов
+    void Compact();
+};
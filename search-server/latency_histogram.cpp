@@ -0,0 +1,81 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Номер старшего единичного бита, value > 0
+size_t FloorLog2(uint64_t value) {
+    size_t result = 0;
+    for (size_t shift = 32; shift > 0; shift /= 2) {
+        if (value >> shift) {
+            value >>= shift;
+            result += shift;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+size_t LatencyHistogram::GetBucket(chrono::nanoseconds latency) {
+    const uint64_t value = max<int64_t>(latency.count(), 0);
+    // малые значения хранятся точно
+    if (value < SUB_BUCKET_COUNT) {
+        return value;
+    }
+    const size_t exponent = FloorLog2(value);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    const size_t sub_bucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+    return SUB_BUCKET_COUNT + (exponent - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+chrono::nanoseconds LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT) {
+        return chrono::nanoseconds(bucket);
+    }
+    const size_t shift = (bucket - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT;
+    const uint64_t sub_bucket = (bucket - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+    const uint64_t lower_bound = (SUB_BUCKET_COUNT + sub_bucket) << shift;
+    return chrono::nanoseconds(lower_bound + (uint64_t{1} << shift) - 1);
+}
+
+void LatencyHistogram::Add(size_t bucket, uint64_t count) {
+    counts_[bucket] += count;
+    count_ += count;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        counts_[bucket] += other.counts_[bucket];
+    }
+    count_ += other.count_;
+}
+
+void LatencyHistogram::Record(chrono::nanoseconds latency) {
+    Add(GetBucket(latency), 1);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_;
+}
+
+chrono::nanoseconds LatencyHistogram::GetQuantile(double quantile) const {
+    if (count_ == 0) {
+        return chrono::nanoseconds(0);
+    }
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(clamp(quantile, 0.0, 1.0) * count_)));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += counts_[bucket];
+        if (seen >= rank) {
+            return GetBucketUpperBound(bucket);
+        }
+    }
+    return GetBucketUpperBound(BUCKET_COUNT - 1);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Гистограмма задержек в духе HDR: каждый интервал [2^k, 2^(k+1)) делится на SUB_BUCKET_COUNT равных
+// корзин, поэтому квантили считаются с относительной ошибкой не больше 1/SUB_BUCKET_COUNT при любом масштабе
+class LatencyHistogram {
+public:
+    static const size_t SUB_BUCKET_BITS = 5;
+    static const size_t SUB_BUCKET_COUNT = size_t{1} << SUB_BUCKET_BITS;
+    // задержки от 2^(MAX_EXPONENT + 1) нс (около двух минут) попадают в последнюю корзину
+    static const size_t MAX_EXPONENT = 36;
+    static const size_t BUCKET_COUNT = SUB_BUCKET_COUNT + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static size_t GetBucket(std::chrono::nanoseconds latency);
+
+    // Наибольшая задержка, попадающая в корзину
+    static std::chrono::nanoseconds GetBucketUpperBound(size_t bucket);
+
+    void Add(size_t bucket, uint64_t count);
+
+    void Merge(const LatencyHistogram& other);
+
+    void Record(std::chrono::nanoseconds latency);
+
+    uint64_t GetCount() const;
+
+    // Наименьшая граница корзины, до которой включительно набирается доля quantile задержек; 0 для пустой гистограммы
+    std::chrono::nanoseconds GetQuantile(double quantile) const;
+
+private:
+    std::array<uint64_t, BUCKET_COUNT> counts_{};
+    uint64_t count_ = 0;
+};
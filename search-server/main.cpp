@@ -1,15 +1,55 @@
 #include "search_server.h"
 #include "process_queries.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "tracing.h"
 #include "log_duration.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
 #include <execution>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <new>
 #include <random>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace std;
 
+// считаем обращения к куче, чтобы видеть, сколько выделений памяти приходится на один запрос
+static atomic<size_t> allocation_count = 0;
+
+// Замены operator new и operator delete не встраиваются: если встроено только одно из них, GCC видит
+// в месте вызова free от указателя из operator new или наоборот и предупреждает -Wmismatched-new-delete.
+// Без трассировки operator new встраивался, а с ней - нет
+[[gnu::noinline]] void* operator new(size_t size) {
+    ++allocation_count;
+    TRACE_COUNT(ALLOCATIONS, 1);
+    if (void* ptr = malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
 string GenerateWord(mt19937& generator, int max_length) {
     const int length = uniform_int_distribution(1, max_length)(generator);
     string word;
@@ -53,33 +93,886 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
+// Повторяет запросы из base_queries, переставляя и иногда дублируя слова, как это делают пользователи
+vector<string> GenerateRepeatedQueries(mt19937& generator, const vector<string>& base_queries, int query_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        const string& base_query = base_queries[uniform_int_distribution<int>(0, base_queries.size() - 1)(generator)];
+        vector<string_view> words = SplitIntoWords(base_query);
+        shuffle(words.begin(), words.end(), generator);
+        if (uniform_int_distribution(0, 1)(generator) == 1) {
+            words.push_back(words.front());
+        }
+        string query;
+        for (const string_view word : words) {
+            if (!query.empty()) {
+                query.push_back(' ');
+            }
+            query += word;
+        }
+        queries.push_back(move(query));
+    }
+    return queries;
+}
+
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
     double total_relevance = 0;
+    // первый проход прогревает переиспользуемые буферы
     for (const string_view query : queries) {
-        for (const auto& document : search_server.FindTopDocuments(policy, query)) {
-            total_relevance += document.relevance;
+        search_server.FindTopDocuments(policy, query);
+    }
+    const size_t allocations_before = allocation_count;
+    const SearchServer::PruningStats pruning_before = search_server.GetPruningStats();
+    {
+        const string operation(mark);
+        LOG_DURATION(operation);
+        for (const string_view query : queries) {
+            for (const auto& document : search_server.FindTopDocuments(policy, query)) {
+                total_relevance += document.relevance;
+            }
         }
     }
+    const SearchServer::PruningStats pruning_after = search_server.GetPruningStats();
+    cerr << mark << ": "s << (allocation_count - allocations_before) * 1.0 / queries.size() << " allocations per query, "s
+         << (pruning_after.scanned_postings - pruning_before.scanned_postings) / queries.size() << " postings scanned, "s
+         << (pruning_after.skipped_postings - pruning_before.skipped_postings) / queries.size() << " skipped per query"s << endl;
 }
 
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
+// Сравнивает пакетные функции на одном и том же наборе запросов
+void TestBatch(const SearchServer& search_server, const vector<string>& queries) {
+    const auto measure = [&queries](string_view mark, auto process) {
+        const size_t allocations_before = allocation_count;
+        size_t result_count = 0;
+        {
+            const string operation(mark);
+            LOG_DURATION(operation);
+            result_count = process();
+        }
+        cerr << mark << ": "s << result_count << " documents, "s
+             << (allocation_count - allocations_before) * 1.0 / queries.size() << " allocations per query"s << endl;
+    };
+    measure("ProcessQueries"s, [&] {
+        size_t count = 0;
+        for (const auto& documents : ProcessQueries(search_server, queries)) {
+            count += documents.size();
+        }
+        return count;
+    });
+    measure("ProcessQueriesJoined"s, [&] {
+        return ProcessQueriesJoined(search_server, queries).size();
+    });
+    measure("ProcessQueriesBatch"s, [&] {
+        return ProcessQueriesBatch(search_server, queries).GetDocuments().size();
+    });
+}
+
+// Читатели выполняют запросы, пока писатель добавляет и удаляет документы; печатаются квантили задержки запроса.
+// С global_lock все обращения к серверу проходят через общий shared_mutex, как было до версионирования индекса
+void StressTest(string_view mark, SearchServer& search_server, const vector<string>& documents, const vector<string>& queries, bool global_lock) {
+    shared_mutex server_mutex;
+    atomic<bool> is_writing = true;
+    const size_t reader_count = max(2u, thread::hardware_concurrency());
+    vector<vector<double>> latencies(reader_count);
+    vector<thread> readers;
+    for (size_t reader = 0; reader < reader_count; ++reader) {
+        readers.emplace_back([&, reader] {
+            for (size_t i = reader; is_writing; i += reader_count) {
+                const auto start = chrono::steady_clock::now();
+                if (global_lock) {
+                    shared_lock lock(server_mutex);
+                    search_server.FindTopDocuments(queries[i % queries.size()]);
+                } else {
+                    search_server.FindTopDocuments(queries[i % queries.size()]);
+                }
+                latencies[reader].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+            }
+        });
+    }
+    
+    const int first_id = search_server.GetDocumentCount();
+    for (size_t i = 0; i < documents.size(); ++i) {
+        unique_lock lock(server_mutex, defer_lock);
+        if (global_lock) {
+            lock.lock();
+        }
+        search_server.AddDocument(first_id + i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        if (i % 2 == 1) {
+            search_server.RemoveDocument(first_id + i - 1);
+        }
+    }
+    is_writing = false;
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    
+    vector<double> all_latencies;
+    for (const auto& reader_latencies : latencies) {
+        all_latencies.insert(all_latencies.end(), reader_latencies.begin(), reader_latencies.end());
+    }
+    sort(all_latencies.begin(), all_latencies.end());
+    const auto quantile = [&all_latencies](double q) {
+        return all_latencies.empty() ? 0.0 : all_latencies[static_cast<size_t>(q * (all_latencies.size() - 1))];
+    };
+    cerr << mark << ": "s << all_latencies.size() << " queries, latency us p50 "s << quantile(0.5) << ", p99 "s << quantile(0.99)
+         << ", p99.9 "s << quantile(0.999) << ", max "s << quantile(1.0) << endl;
+}
+
+void Check(bool condition, string_view message) {
+    if (!condition) {
+        cerr << "check failed: "s << message << endl;
+        abort();
+    }
+}
+
+// Сверяет выдачу двух серверов с одинаковыми документами: поиск с фильтрами по статусу и рейтингу
+// и MatchDocument каждого документа
+void CheckSameResults(const SearchServer& expected, const SearchServer& actual, const vector<string>& queries, string_view mark) {
+    Check(expected.GetDocumentCount() == actual.GetDocumentCount(), string(mark) + ": document count"s);
+    const vector<DocumentFilter> filters = {{}, {DocumentStatus::BANNED}, {nullopt, -2, 3}};
+    for (const string& query : queries) {
+        for (const DocumentFilter& filter : filters) {
+            const vector<Document> expected_found = expected.FindTopDocuments(query, filter);
+            const vector<Document> found = actual.FindTopDocuments(query, filter);
+            Check(found.size() == expected_found.size(), string(mark) + ": result count for query "s + query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                Check(found[i].id == expected_found[i].id && found[i].rating == expected_found[i].rating
+                      && abs(found[i].relevance - expected_found[i].relevance) < RELEVANCE_EPSILON, string(mark) + ": result for query "s + query);
+            }
+        }
+    }
+    for (const int document_id : expected) {
+        const auto [expected_words, expected_status] = expected.MatchDocument(queries[document_id % queries.size()], document_id);
+        const auto [words, status] = actual.MatchDocument(queries[document_id % queries.size()], document_id);
+        Check(words == expected_words && status == expected_status, string(mark) + ": match of document "s + to_string(document_id));
+        const auto expected_freqs = expected.GetWordFrequencies(document_id);
+        const auto freqs = actual.GetWordFrequencies(document_id);
+        Check(freqs.size() == expected_freqs.size() && all_of(expected_freqs.begin(), expected_freqs.end(), [&freqs](const auto& word_freq) {
+            const auto it = freqs.find(word_freq.first);
+            return it != freqs.end() && abs(it->second - word_freq.second) < RELEVANCE_EPSILON;
+        }), string(mark) + ": word frequencies of document "s + to_string(document_id));
+    }
+}
+
+// Сверяет FindTopDocuments с полным перебором по определению TF-IDF: отсечение по верхним оценкам
+// и окна документов не должны менять выдачу, в том числе после удалений
+void CheckAgainstBruteForce(mt19937& generator, const vector<string>& dictionary) {
+    struct ReferenceDocument {
+        map<string, int> word_counts;
+        int word_count = 0;
+        DocumentStatus status;
+        int rating;
+    };
+    // маленький словарь, чтобы у слов были длинные списки постингов на несколько окон
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 40);
+    const string& stop_word = words[0];
+    SearchServer search_server(stop_word);
+    map<int, ReferenceDocument> documents;
+    for (int id = 0; id < 12'000; ++id) {
+        const string text = GenerateQuery(generator, words, uniform_int_distribution(1, 12)(generator));
+        ReferenceDocument& document = documents[id];
+        for (const string_view word : SplitIntoWords(text)) {
+            if (word != stop_word) {
+                ++document.word_counts[string(word)];
+                ++document.word_count;
+            }
+        }
+        document.status = uniform_int_distribution(0, 3)(generator) == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        document.rating = uniform_int_distribution(-5, 5)(generator);
+        search_server.AddDocument(id, text, document.status, {document.rating});
+    }
+    vector<int> removed_ids;
+    for (int id = 0; id < 12'000; id += 3) {
+        removed_ids.push_back(id);
+        documents.erase(id);
+    }
+    search_server.RemoveDocuments(removed_ids);
+    
+    for (int i = 0; i < 300; ++i) {
+        const string query = GenerateQuery(generator, words, uniform_int_distribution(1, 5)(generator), 0.1);
+        set<string> plus_words;
+        set<string> minus_words;
+        for (const string_view word : SplitIntoWords(query)) {
+            if (word[0] == '-') {
+                minus_words.emplace(word.substr(1));
+            } else if (word != stop_word) {
+                plus_words.emplace(word);
+            }
+        }
+        map<int, double> expected;
+        for (const string& word : plus_words) {
+            const size_t document_freq = count_if(documents.begin(), documents.end(), [&word](const auto& document) {
+                return document.second.word_counts.count(word) > 0;
+            });
+            if (document_freq == 0) {
+                continue;
+            }
+            const double inverse_document_freq = log(documents.size() * 1.0 / document_freq);
+            for (const auto& [id, document] : documents) {
+                const auto it = document.word_counts.find(word);
+                if (it != document.word_counts.end() && document.status == DocumentStatus::ACTUAL) {
+                    expected[id] += it->second * 1.0 / document.word_count * inverse_document_freq;
+                }
+            }
+        }
+        for (auto it = expected.begin(); it != expected.end();) {
+            const auto& word_counts = documents.at(it->first).word_counts;
+            const bool has_minus_word = any_of(minus_words.begin(), minus_words.end(), [&word_counts](const string& word) {
+                return word_counts.count(word) > 0;
+            });
+            it = has_minus_word ? expected.erase(it) : next(it);
+        }
+        vector<double> expected_relevances;
+        for (const auto& [id, relevance] : expected) {
+            expected_relevances.push_back(relevance);
+        }
+        sort(expected_relevances.rbegin(), expected_relevances.rend());
+        
+        const vector<Document> found = search_server.FindTopDocuments(query);
+        Check(found.size() == min<size_t>(MAX_RESULT_DOCUMENT_COUNT, expected.size()), "result count for query "s + query);
+        for (size_t j = 0; j < found.size(); ++j) {
+            Check(expected.count(found[j].id) > 0 && abs(expected.at(found[j].id) - found[j].relevance) < RELEVANCE_EPSILON,
+                  "relevance of document "s + to_string(found[j].id) + " for query "s + query);
+            Check(abs(found[j].relevance - expected_relevances[j]) < RELEVANCE_EPSILON, "ranking for query "s + query);
+        }
+    }
+    cerr << "brute force check passed"s << endl;
+}
+
+// Дубликаты - документы с тем же набором слов, что у документа с меньшим идентификатором, независимо
+// от порядка, повторов и стоп-слов. Сверяется с перебором по наборам слов
+void CheckDuplicates(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 12);
+    const string& stop_word = words[0];
+    SearchServer search_server(stop_word);
+    map<int, set<string>> word_sets;
+    const auto add = [&](int id, const vector<string>& text_words) {
+        string text;
+        for (const string& word : text_words) {
+            text += (text.empty() ? ""s : " "s) + word;
+            if (word != stop_word) {
+                word_sets[id].insert(word);
+            }
+        }
+        search_server.AddDocument(id, text, DocumentStatus::ACTUAL, {1});
+    };
+    // один набор слов в другом порядке, с повторами и стоп-словом; меньший идентификатор добавлен не первым
+    add(10, {words[1], words[2], words[3]});
+    add(4, {words[3], words[1], words[2], words[2]});
+    add(25, {stop_word, words[2], words[3], words[1], words[1]});
+    // почти дубликаты: подмножество, надмножество и набор с одним другим словом
+    add(12, {words[1], words[2]});
+    add(13, {words[1], words[2], words[3], words[4]});
+    add(14, {words[1], words[2], words[5]});
+    // удалённый документ не оставляет за собой свои дубликаты
+    add(2, {words[6], words[7]});
+    add(3, {words[7], words[6], words[6]});
+    add(7, {words[6], words[7]});
+    search_server.RemoveDocument(2);
+    word_sets.erase(2);
+    // случайные документы попадают в разные части по отпечаткам
+    const vector<string> content_words(words.begin() + 1, words.end());
+    for (int id = 100; id < 2'100; ++id) {
+        vector<string> text_words;
+        for (int i = uniform_int_distribution(1, 4)(generator); i > 0; --i) {
+            text_words.push_back(content_words[uniform_int_distribution<size_t>(0, content_words.size() - 1)(generator)]);
+        }
+        add(id, text_words);
+    }
+    
+    map<set<string>, int> originals;
+    vector<int> expected_duplicates;
+    for (const auto& [id, word_set] : word_sets) {
+        if (!originals.emplace(word_set, id).second) {
+            expected_duplicates.push_back(id);
+        }
+    }
+    const vector<int> duplicates = search_server.FindDuplicates();
+    Check(duplicates == expected_duplicates, "FindDuplicates result"s);
+    for (const int id : {10, 25, 7}) {
+        Check(binary_search(duplicates.begin(), duplicates.end(), id), "duplicate "s + to_string(id) + " is not found"s);
+    }
+    for (const int id : {4, 12, 13, 14, 3}) {
+        Check(!binary_search(duplicates.begin(), duplicates.end(), id), "document "s + to_string(id) + " is taken for a duplicate"s);
+    }
+    
+    // RemoveDuplicates сообщает о каждом удалённом документе в cout
+    ostringstream messages;
+    streambuf* const cout_buffer = cout.rdbuf(messages.rdbuf());
+    RemoveDuplicates(search_server);
+    cout.rdbuf(cout_buffer);
+    const string messages_text = messages.str();
+    Check(static_cast<size_t>(count(messages_text.begin(), messages_text.end(), '\n')) == duplicates.size(), "RemoveDuplicates messages"s);
+    vector<int> expected_ids;
+    for (const auto& [word_set, id] : originals) {
+        expected_ids.push_back(id);
+    }
+    sort(expected_ids.begin(), expected_ids.end());
+    Check(vector<int>(search_server.begin(), search_server.end()) == expected_ids, "documents kept by RemoveDuplicates"s);
+    Check(search_server.FindDuplicates().empty(), "duplicates left after RemoveDuplicates"s);
+    cerr << "duplicates check passed"s << endl;
+}
+
+// MatchDocuments отвечает для каждого id так же, как MatchDocument, и не принимает неизвестные id
+void CheckMatchDocumentsMatchesLoop(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 60);
+    const auto texts = GenerateQueries(generator, words, 3'000, 10);
+    const DocumentStatus statuses[] = {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED};
+    SearchServer search_server(words[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], statuses[i % 3], {1});
+    }
+    vector<int> ids;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        if (i % 7 == 0) {
+            search_server.RemoveDocument(i);
+        } else {
+            ids.push_back(i);
+        }
+    }
+    shuffle(ids.begin(), ids.end(), generator);
+    
+    bool minus_word_hit = false;
+    for (int i = 0; i < 30; ++i) {
+        const string query = GenerateQuery(generator, words, 5, 0.3);
+        const auto seq_results = search_server.MatchDocuments(execution::seq, query, ids);
+        const auto par_results = search_server.MatchDocuments(execution::par, query, ids);
+        Check(seq_results.size() == ids.size() && par_results.size() == ids.size(), "MatchDocuments result count for query "s + query);
+        for (size_t j = 0; j < ids.size(); ++j) {
+            const auto expected = search_server.MatchDocument(query, ids[j]);
+            Check(seq_results[j] == expected, "MatchDocuments seq differs for query "s + query + " document "s + to_string(ids[j]));
+            Check(par_results[j] == expected, "MatchDocuments par differs for query "s + query + " document "s + to_string(ids[j]));
+            minus_word_hit = minus_word_hit || get<0>(expected).empty();
+        }
+    }
+    Check(minus_word_hit, "MatchDocuments check has no documents excluded by minus words"s);
+    
+    // удалённый документ в середине списка
+    vector<int> unknown_ids(ids.begin(), ids.begin() + 10);
+    unknown_ids.insert(unknown_ids.begin() + 5, 7);
+    const string query = GenerateQuery(generator, words, 5, 0.3);
+    const auto throws_out_of_range = [&](auto policy) {
+        try {
+            search_server.MatchDocuments(policy, query, unknown_ids);
+        } catch (const out_of_range&) {
+            return true;
+        }
+        return false;
+    };
+    Check(throws_out_of_range(execution::seq), "MatchDocuments seq accepts an unknown id"s);
+    Check(throws_out_of_range(execution::par), "MatchDocuments par accepts an unknown id"s);
+    cerr << "MatchDocuments check passed"s << endl;
+}
+
+// DocumentFilter с диапазоном рейтинга отбирает те же документы, что равносильный предикат,
+// в последовательном, параллельном и кэшированном поиске
+void CheckRatingFilterMatchesPredicate(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 60);
+    const auto texts = GenerateQueries(generator, words, 6'000, 10);
+    vector<string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateQuery(generator, words, 4, 0.2));
+    }
+    const DocumentStatus statuses[] = {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED};
+    SearchServer search_server(words[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], statuses[i % 3], {uniform_int_distribution(-10, 10)(generator)});
+    }
+    vector<int> removed_ids;
+    for (size_t i = 0; i < texts.size(); i += 5) {
+        removed_ids.push_back(i);
+    }
+    search_server.RemoveDocuments(removed_ids);
+    
+    const auto check_same = [](const vector<Document>& found, const vector<Document>& expected, const string& message) {
+        Check(found.size() == expected.size(), message + ": result count"s);
+        for (size_t i = 0; i < found.size(); ++i) {
+            Check(found[i].id == expected[i].id && found[i].rating == expected[i].rating
+                  && abs(found[i].relevance - expected[i].relevance) < RELEVANCE_EPSILON, message + ": result"s);
+        }
+    };
+    const vector<DocumentFilter> filters = {{nullopt, -2, 3}, {DocumentStatus::ACTUAL, -2, 3}, {DocumentStatus::BANNED, 0, 0}, {nullopt, 5, 100}};
+    search_server.SetQueryCacheCapacity(1'000);
+    for (const DocumentFilter& filter : filters) {
+        const auto predicate = [&filter](int, DocumentStatus status, int rating) {
+            return (!filter.status || status == *filter.status) && rating >= filter.min_rating && rating <= filter.max_rating;
+        };
+        for (const string& query : queries) {
+            const string message = "rating filter ["s + to_string(filter.min_rating) + ", "s + to_string(filter.max_rating) + "] for query "s + query;
+            const vector<Document> expected = search_server.FindTopDocuments(execution::seq, query, predicate);
+            check_same(search_server.FindTopDocuments(execution::par, query, predicate), expected, message + " par predicate"s);
+            check_same(search_server.FindTopDocuments(execution::seq, query, filter), expected, message + " seq"s);
+            check_same(search_server.FindTopDocuments(execution::par, query, filter), expected, message + " par"s);
+            // второй поиск берёт результат из кэша
+            check_same(search_server.FindTopDocuments(query, filter), expected, message + " cached"s);
+        }
+    }
+    Check(search_server.GetQueryCacheStats().hits > 0, "rating filter results are not cached"s);
+    cerr << "rating filter check passed"s << endl;
+}
+
+// Пакет AddDocuments индексирует документы так же, как AddDocument по одному, а пакет с ошибкой
+// не меняет сервер
+void CheckBatchAddMatchesLoop(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 60);
+    // больше документов, чем помещается в буфер постингов, чтобы пакет закрывал буферы
+    const auto texts = GenerateQueries(generator, words, 10'000, 10);
+    vector<string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateQuery(generator, words, 4, 0.2));
+    }
+    const DocumentStatus statuses[] = {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED};
+    SearchServer loop_server(words[0]);
+    SearchServer batch_server(words[0]);
+    vector<NewDocument> batch;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const vector<int> ratings = {static_cast<int>(i % 7) - 3, static_cast<int>(i % 5)};
+        loop_server.AddDocument(i * 3, texts[i], statuses[i % 3], ratings);
+        batch.push_back({static_cast<int>(i * 3), texts[i], statuses[i % 3], ratings});
+    }
+    batch_server.AddDocuments(batch);
+    CheckSameResults(loop_server, batch_server, queries, "AddDocuments batch"s);
+    
+    const auto check_rejected = [&](const vector<NewDocument>& invalid_batch, string_view mark) {
+        bool is_rejected = false;
+        try {
+            batch_server.AddDocuments(invalid_batch);
+        } catch (const invalid_argument&) {
+            is_rejected = true;
+        }
+        Check(is_rejected, string(mark) + " is accepted"s);
+        CheckSameResults(loop_server, batch_server, queries, mark);
+    };
+    const string invalid_text = texts[0] + " bad\x01word"s;
+    check_rejected({{1, texts[1], DocumentStatus::ACTUAL, {1}}, {2, invalid_text, DocumentStatus::ACTUAL, {1}}}, "batch with an invalid word"s);
+    check_rejected({{1, texts[1], DocumentStatus::ACTUAL, {1}}, {1, texts[2], DocumentStatus::ACTUAL, {1}}}, "batch with a repeated id"s);
+    check_rejected({{1, texts[1], DocumentStatus::ACTUAL, {1}}, {3, texts[2], DocumentStatus::ACTUAL, {1}}}, "batch with an existing id"s);
+    cerr << "batch add check passed"s << endl;
+}
+
+// Снимок отдаёт ту же выдачу, что и сохранённый сервер, в том числе после добавления и удаления документов
+// поверх отображённого файла
+void CheckSnapshotRoundTrip(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 60);
+    const auto texts = GenerateQueries(generator, words, 3'000, 10);
+    vector<string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateQuery(generator, words, 4, 0.2));
+    }
+    const DocumentStatus statuses[] = {DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED};
+    SearchServer saved_server(words[0]);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        saved_server.AddDocument(i * 2, texts[i], statuses[i % 3], {static_cast<int>(i % 11) - 5});
+    }
+    vector<int> removed_ids;
+    for (size_t i = 0; i < texts.size(); i += 7) {
+        removed_ids.push_back(i * 2);
+    }
+    saved_server.RemoveDocuments(removed_ids);
+
+    const string snapshot_path = "search_server_check.snapshot"s;
+    saved_server.SaveSnapshot(snapshot_path);
+    SearchServer verified_server = SearchServer::LoadSnapshot(snapshot_path);
+    SearchServer unverified_server = SearchServer::LoadSnapshot(snapshot_path, false);
+    CheckSameResults(saved_server, verified_server, queries, "loaded snapshot"s);
+    CheckSameResults(saved_server, unverified_server, queries, "loaded snapshot without checksums"s);
+    // новый документ попадает в хвосты колонок, удалённый снимается с карт из файла
+    for (SearchServer* server : {&saved_server, &verified_server, &unverified_server}) {
+        server->AddDocument(1'000'001, texts[1], DocumentStatus::ACTUAL, {4});
+        server->RemoveDocument(2);
+    }
+    CheckSameResults(saved_server, verified_server, queries, "modified snapshot"s);
+    CheckSameResults(saved_server, unverified_server, queries, "modified snapshot without checksums"s);
+    remove(snapshot_path.c_str());
+    cerr << "snapshot round trip check passed"s << endl;
+}
+
+string ReadFile(const string& path) {
+    ifstream input(path, ios::binary);
+    return string(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+}
+
+// Счётчики памяти растут при добавлении, уменьшаются при удалении и сжатии, а у загруженного снимка
+// данные переходят из кучи в отображённый файл
+void CheckMemoryStats(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 60);
+    const auto texts = GenerateQueries(generator, words, 4'000, 10);
+    SearchServer search_server(words[0]);
+    const SearchServer::MemoryStats empty_stats = search_server.GetMemoryStats();
+    Check(empty_stats.document_count == 0 && empty_stats.posting_count == 0 && empty_stats.snapshot_bytes == 0, "memory stats of an empty server"s);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {1});
+    }
+    const SearchServer::MemoryStats added_stats = search_server.GetMemoryStats();
+    Check(added_stats.document_count == texts.size(), "memory stats document count after add"s);
+    Check(added_stats.term_count > 0 && added_stats.posting_count > 0, "memory stats term and posting counts after add"s);
+    Check(added_stats.total_bytes > empty_stats.total_bytes && added_stats.documents_bytes > empty_stats.documents_bytes
+          && added_stats.forward_index_bytes > empty_stats.forward_index_bytes, "memory stats bytes after add"s);
+    Check(added_stats.total_bytes == added_stats.terms_bytes + added_stats.postings_bytes + added_stats.posting_buffer_bytes
+          + added_stats.forward_index_bytes + added_stats.documents_bytes + added_stats.attributes_bytes
+          + added_stats.document_ids_bytes + added_stats.stop_words_bytes, "memory stats total is not the sum of parts"s);
+    
+    vector<int> removed_ids;
+    for (size_t i = 0; i < texts.size(); i += 2) {
+        removed_ids.push_back(i);
+    }
+    search_server.RemoveDocuments(removed_ids);
+    const SearchServer::MemoryStats removed_stats = search_server.GetMemoryStats();
+    Check(removed_stats.document_count == texts.size() - removed_ids.size(), "memory stats document count after remove"s);
+    Check(removed_stats.posting_count < added_stats.posting_count, "memory stats posting count after remove"s);
+    Check(removed_stats.forward_index_bytes < added_stats.forward_index_bytes, "memory stats forward index bytes after remove"s);
+    
+    search_server.CompactIndex();
+    const SearchServer::MemoryStats compacted_stats = search_server.GetMemoryStats();
+    Check(compacted_stats.document_count == removed_stats.document_count && compacted_stats.posting_count == removed_stats.posting_count,
+          "memory stats counts change on compaction"s);
+    Check(compacted_stats.postings_bytes + compacted_stats.posting_buffer_bytes <= removed_stats.postings_bytes + removed_stats.posting_buffer_bytes,
+          "memory stats postings grow on compaction"s);
+    
+    const string snapshot_path = "search_server_memory_check.snapshot"s;
+    search_server.SaveSnapshot(snapshot_path);
+    const SearchServer loaded_server = SearchServer::LoadSnapshot(snapshot_path);
+    const SearchServer::MemoryStats loaded_stats = loaded_server.GetMemoryStats();
+    Check(loaded_stats.snapshot_bytes == ReadFile(snapshot_path).size(), "memory stats snapshot bytes differ from the file size"s);
+    Check(loaded_stats.document_count == compacted_stats.document_count && loaded_stats.posting_count == compacted_stats.posting_count
+          && loaded_stats.term_count == compacted_stats.term_count, "memory stats counts after snapshot load"s);
+    Check(loaded_stats.total_bytes < compacted_stats.total_bytes, "memory stats heap bytes do not shrink after snapshot load"s);
+    remove(snapshot_path.c_str());
+    cerr << "memory stats check passed"s << endl;
+}
+
+// Снимок из контрольной точки и журнал после неё восстанавливают тот же индекс. В журнале остаются
+// записи до контрольной точки, которые надо пропустить, и оборванная последняя запись, которую надо отбросить
+void CheckWriteAheadLogRecovery(mt19937& generator, const vector<string>& dictionary) {
+    const vector<string> words(dictionary.begin(), dictionary.begin() + 60);
+    const auto texts = GenerateQueries(generator, words, 2'000, 10);
+    vector<string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateQuery(generator, words, 4, 0.2));
+    }
+    const string snapshot_path = "search_server_check.snapshot"s;
+    const string log_path = "search_server_check.wal"s;
+    remove(log_path.c_str());
+    
+    // expected получает те же изменения без журнала, кроме оборванного добавления
+    SearchServer expected(words[0]);
+    SearchServer logged_server(words[0]);
+    logged_server.OpenWriteAheadLog(log_path, 0);
+    const auto apply_changes = [&texts](SearchServer& server, int first_id) {
+        for (int i = 0; i < 300; ++i) {
+            server.AddDocument(first_id + i, texts[first_id + i], i % 4 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {i % 7 - 3});
+        }
+        vector<NewDocument> batch;
+        for (int i = 300; i < 1'000; ++i) {
+            batch.push_back({first_id + i, texts[first_id + i], DocumentStatus::ACTUAL, {i % 5}});
+        }
+        server.AddDocuments(batch);
+        vector<int> removed_ids;
+        for (int i = 0; i < 1'000; i += 9) {
+            removed_ids.push_back(first_id + i);
+        }
+        server.RemoveDocuments(removed_ids);
+        server.RemoveDocument(first_id + 500);
+    };
+    apply_changes(expected, 0);
+    apply_changes(logged_server, 0);
+    logged_server.SyncWriteAheadLog();
+    const string checkpointed_log = ReadFile(log_path);
+    logged_server.Checkpoint(snapshot_path);
+    
+    apply_changes(expected, 1'000);
+    apply_changes(logged_server, 1'000);
+    logged_server.SyncWriteAheadLog();
+    const string log_after_checkpoint = ReadFile(log_path);
+    logged_server.AddDocument(1'000'000, texts[0], DocumentStatus::ACTUAL, {1});
+    logged_server.SyncWriteAheadLog();
+    const string torn_record = ReadFile(log_path).substr(log_after_checkpoint.size());
+    {
+        // обрезка журнала в контрольной точке не дошла до диска, последняя запись оборвалась
+        ofstream output(log_path, ios::binary | ios::trunc);
+        output << checkpointed_log << log_after_checkpoint << torn_record.substr(0, torn_record.size() / 2);
+    }
+    
+    SearchServer recovered_server = SearchServer::LoadSnapshot(snapshot_path);
+    recovered_server.OpenWriteAheadLog(log_path, 0);
+    CheckSameResults(expected, recovered_server, queries, "recovered from write-ahead log"s);
+    // оборванная запись отброшена, и новые записи продолжают журнал после последней целой
+    expected.AddDocument(1'000'000, texts[1], DocumentStatus::ACTUAL, {2});
+    recovered_server.AddDocument(1'000'000, texts[1], DocumentStatus::ACTUAL, {2});
+    recovered_server.SyncWriteAheadLog();
+    SearchServer recovered_again = SearchServer::LoadSnapshot(snapshot_path);
+    recovered_again.OpenWriteAheadLog(log_path, 0);
+    CheckSameResults(expected, recovered_again, queries, "recovered twice from write-ahead log"s);
+    remove(snapshot_path.c_str());
+    remove(log_path.c_str());
+    cerr << "write-ahead log recovery check passed"s << endl;
+}
+
+// Поток, ждущий окончания ParallelFor, не должен выполнять чужие задачи: здесь чужая задача ждёт результата,
+// который вызвавший цикл поток отдаёт только после цикла, и её выполнение этим потоком означало бы зависание
+void CheckParallelForRunsOnlyOwnIndices() {
+    ThreadPool thread_pool(1);
+    promise<void> result_after_loop;
+    shared_future<void> result = result_after_loop.get_future().share();
+    atomic<size_t> started_count = 0;
+    atomic<bool> is_submitted = false;
+    auto loop = async(launch::async, [&] {
+        const thread::id caller_id = this_thread::get_id();
+        thread_pool.ParallelFor(2, [&](size_t) {
+            // индексы достаются разным потокам: первый ждёт, пока второй индекс возьмёт другой поток
+            ++started_count;
+            while (started_count < 2) {
+                this_thread::yield();
+            }
+            if (this_thread::get_id() == caller_id) {
+                return;
+            }
+            thread_pool.Submit([result] {
+                result.wait();
+            });
+            is_submitted = true;
+            // вызвавший поток тем временем ждёт конца цикла при стоящей в очереди чужой задаче
+            this_thread::sleep_for(chrono::milliseconds(100));
+        });
+        result_after_loop.set_value();
+    });
+    Check(loop.wait_for(chrono::seconds(10)) == future_status::ready && is_submitted, "ParallelFor waiter ran a foreign task"s);
+    cerr << "ParallelFor waiter check passed"s << endl;
+}
+
+// Регрессия: поток, ждущий окончания ParallelFor, выполнял чужие задачи пула. Такой задачей мог оказаться
+// запрос, ждущий в кэше результата, который вычисляет этот же поток, и работа останавливалась навсегда
+void CheckQueryCacheUnderParallelLoad(mt19937& generator, const vector<string>& dictionary) {
+    SearchServer search_server(dictionary[0]);
+    vector<NewDocument> documents;
+    const auto texts = GenerateQueries(generator, dictionary, 40'000, 5);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        documents.push_back({static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {1}});
+    }
+    search_server.AddDocuments(documents);
+    search_server.SetWorkerCount(2);
+    search_server.SetQueryCacheCapacity(100);
+    
+    const string query = GenerateQuery(generator, dictionary, 5);
+    const vector<string> same_queries(64, query);
+    auto load = async(launch::async, [&] {
+        atomic<bool> is_writing = true;
+        thread writer([&] {
+            for (int i = 0; i < 200; ++i) {
+                search_server.AddDocument(1'000'000 + i, texts[i], DocumentStatus::ACTUAL, {1});
+            }
+            is_writing = false;
+        });
+        vector<thread> readers;
+        for (int reader = 0; reader < 2; ++reader) {
+            readers.emplace_back([&] {
+                while (is_writing) {
+                    ProcessQueries(search_server, same_queries);
+                    search_server.FindTopDocuments(execution::par, query);
+                }
+            });
+        }
+        writer.join();
+        for (thread& reader : readers) {
+            reader.join();
+        }
+    });
+    Check(load.wait_for(chrono::seconds(60)) == future_status::ready, "query cache under parallel load made no progress"s);
+    cerr << "query cache under parallel load check passed"s << endl;
+}
+
 int main() { // здесь производится запуск последовательной и параллельной версии
             // и сравнивается быстродействие
     mt19937 generator;
 
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
+    
+    {
+        mt19937 check_generator;
+        CheckParallelForRunsOnlyOwnIndices();
+        CheckAgainstBruteForce(check_generator, dictionary);
+        CheckQueryCacheUnderParallelLoad(check_generator, dictionary);
+        CheckBatchAddMatchesLoop(check_generator, dictionary);
+        CheckDuplicates(check_generator, dictionary);
+        CheckRatingFilterMatchesPredicate(check_generator, dictionary);
+        CheckMatchDocumentsMatchesLoop(check_generator, dictionary);
+        CheckSnapshotRoundTrip(check_generator, dictionary);
+        CheckWriteAheadLogRecovery(check_generator, dictionary);
+        CheckMemoryStats(check_generator, dictionary);
+    }
 
     SearchServer search_server(dictionary[0]);
-    for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+    {
+        LOG_DURATION("AddDocument loop"s);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+    }
+    
+    {
+        vector<NewDocument> batch;
+        batch.reserve(documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            batch.push_back({static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3}});
+        }
+        SearchServer batch_server(dictionary[0]);
+        LOG_DURATION("AddDocuments"s);
+        batch_server.AddDocuments(batch);
+    }
+
+    {
+        const string log_path = "search_server.wal"s;
+        remove(log_path.c_str());
+        SearchServer logged_server(dictionary[0]);
+        logged_server.OpenWriteAheadLog(log_path, 1024);
+        {
+            LOG_DURATION("AddDocument loop with WAL"s);
+            for (size_t i = 0; i < documents.size(); ++i) {
+                logged_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            }
+            logged_server.SyncWriteAheadLog();
+        }
+        SearchServer recovered_server(dictionary[0]);
+        {
+            LOG_DURATION("WAL replay"s);
+            recovered_server.OpenWriteAheadLog(log_path);
+        }
+        remove(log_path.c_str());
+    }
+
+    {
+        SearchServer loop_server(dictionary[0]);
+        SearchServer bulk_server(dictionary[0]);
+        vector<int> removed_ids;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            loop_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            bulk_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+            if (i % 2 == 0) {
+                removed_ids.push_back(i);
+            }
+        }
+        {
+            LOG_DURATION("RemoveDocument loop"s);
+            for (const int document_id : removed_ids) {
+                loop_server.RemoveDocument(document_id);
+            }
+        }
+        {
+            LOG_DURATION("RemoveDocuments"s);
+            bulk_server.RemoveDocuments(removed_ids);
+        }
     }
 
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
 
     TEST(seq);
     TEST(par);
+    
+    TestBatch(search_server, GenerateQueries(generator, dictionary, 20'000, 7));
+    
+    // параллельные запросы и пакеты при разном числе работников пула
+    {
+        const auto batch_queries = GenerateQueries(generator, dictionary, 5'000, 7);
+        for (const size_t worker_count : {1u, 2u, 4u}) {
+            search_server.SetWorkerCount(worker_count);
+            cerr << "workers: "s << worker_count << endl;
+            Test("par"s, search_server, queries, execution::par);
+            TestBatch(search_server, batch_queries);
+        }
+        search_server.SetWorkerCount(thread::hardware_concurrency());
+    }
+    
+    // асинхронные запросы со сроком: длинные запросы, не уложившиеся в срок, возвращают неполный результат
+    {
+        const auto long_queries = GenerateQueries(generator, dictionary, 1'000, 300);
+        // короткая очередь: отправитель ждёт места, и срок не тратится на ожидание в очереди пула
+        search_server.SetMaxPendingQueries(4);
+        for (const auto budget : {chrono::microseconds(100), chrono::microseconds(10'000)}) {
+            vector<future<FindResult>> results;
+            size_t truncated_count = 0;
+            {
+                LOG_DURATION("SubmitFind with budget "s + to_string(budget.count()) + " us"s);
+                for (const string& query : long_queries) {
+                    results.push_back(search_server.SubmitFind(query, DocumentStatus::ACTUAL, chrono::steady_clock::now() + budget));
+                }
+                for (auto& result : results) {
+                    truncated_count += result.get().is_truncated;
+                }
+            }
+            cerr << "truncated "s << truncated_count << " of "s << long_queries.size() << ", rejected "s << search_server.GetRejectedQueryCount() << endl;
+        }
+        search_server.SetMaxPendingQueries(1'024);
+    }
+    
+    const auto short_queries = GenerateQueries(generator, dictionary, 1'000, 3);
+    Test("short seq"s, search_server, short_queries, execution::seq);
+    
+    // запись статистики RequestQueue не должна быть заметна на фоне самого запроса
+    {
+        RequestQueue request_queue(search_server);
+        {
+            LOG_DURATION("short queries directly"s);
+            for (const string& query : short_queries) {
+                search_server.FindTopDocuments(query);
+            }
+        }
+        {
+            LOG_DURATION("short queries through RequestQueue"s);
+            for (const string& query : short_queries) {
+                request_queue.AddFindRequest(query);
+            }
+        }
+        const RequestQueue::Stats stats = request_queue.GetStats();
+        cerr << "request queue: "s << stats.request_count << " requests, "s << stats.queries_per_second << " qps, "s
+             << stats.no_result_rate << " empty, latency us p50 "s << stats.latency_p50.count() / 1000.0 << ", p95 "s << stats.latency_p95.count() / 1000.0
+             << ", p99 "s << stats.latency_p99.count() / 1000.0 << ", p99.9 "s << stats.latency_p999.count() / 1000.0 << endl;
+    }
+    
+    {
+        const auto repeated_queries = GenerateRepeatedQueries(generator, GenerateQueries(generator, dictionary, 200, 10), 20'000);
+        Test("repeated queries"s, search_server, repeated_queries, execution::seq);
+        search_server.SetQueryCacheCapacity(1'000);
+        Test("repeated queries with cache"s, search_server, repeated_queries, execution::seq);
+        const QueryCache::Stats stats = search_server.GetQueryCacheStats();
+        cerr << "query cache: hit rate "s << stats.GetHitRate() << ", "s << stats.hits << " hits, "s << stats.misses << " misses, "s
+             << stats.coalesced << " coalesced, "s << stats.evictions << " evictions"s << endl;
+        search_server.SetQueryCacheCapacity(0);
+    }
+    
+    const string snapshot_path = "search_server.snapshot"s;
+    {
+        LOG_DURATION("SaveSnapshot"s);
+        search_server.SaveSnapshot(snapshot_path);
+    }
+    {
+        LOG_DURATION("LoadSnapshot"s);
+        const SearchServer loaded_server = SearchServer::LoadSnapshot(snapshot_path, false);
+    }
+    {
+        const SearchServer loaded_server = SearchServer::LoadSnapshot(snapshot_path);
+        Test("loaded"s, loaded_server, queries, execution::seq);
+    }
+    remove(snapshot_path.c_str());
+    
+    {
+        const auto stress_documents = GenerateQueries(generator, dictionary, 2'000, 70);
+        const auto stress_queries = GenerateQueries(generator, dictionary, 1'000, 7);
+        SearchServer locked_server(dictionary[0]);
+        StressTest("stress with global lock"s, locked_server, stress_documents, stress_queries, true);
+        SearchServer versioned_server(dictionary[0]);
+        StressTest("stress with versioned index"s, versioned_server, stress_documents, stress_queries, false);
+    }
+    
+#ifdef SEARCH_SERVER_TRACING
+    {
+        ofstream trace_output("search_server_trace.jsonl"s);
+        Tracer::GetInstance().WriteJsonLines(trace_output);
+        cerr << "trace: "s << Tracer::GetInstance().GetRecords().size() << " records written, "s
+             << Tracer::GetInstance().GetDroppedCount() << " dropped"s << endl;
+    }
+#endif
 }
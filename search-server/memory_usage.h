@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Оценки памяти в куче вместе со служебными данными распределителя. Расчёт повторяет glibc malloc:
+// к запрошенному размеру добавляется 8 байт заголовка, сумма округляется до 16 и не бывает меньше 32
+constexpr size_t GetHeapBlockSize(size_t bytes) {
+    return bytes == 0 ? 0 : std::max<size_t>(32, (bytes + 8 + 15) / 16 * 16);
+}
+
+template <typename T>
+size_t GetHeapSize(const std::vector<T>& values) {
+    return GetHeapBlockSize(values.capacity() * sizeof(T));
+}
+
+inline size_t GetHeapSize(const std::vector<bool>& values) {
+    return GetHeapBlockSize((values.capacity() + 7) / 8);
+}
+
+// Короткая строка хранит символы внутри себя
+inline size_t GetHeapSize(const std::string& value) {
+    return value.capacity() > std::string().capacity() ? GetHeapBlockSize(value.capacity() + 1) : 0;
+}
+
+// Узел std::map и std::set: цвет и три указателя перед значением
+template <typename Value>
+constexpr size_t GetTreeNodeSize() {
+    return GetHeapBlockSize(4 * sizeof(void*) + sizeof(Value));
+}
+
+// Узел std::unordered_map: указатель на следующий узел, значение и сохранённый хеш
+template <typename Value>
+constexpr size_t GetHashNodeSize() {
+    return GetHeapBlockSize(2 * sizeof(void*) + sizeof(Value));
+}
+
+// Блок std::make_shared: указатель на таблицу виртуальных функций и два счётчика ссылок перед значением
+template <typename Value>
+constexpr size_t GetSharedBlockSize() {
+    return GetHeapBlockSize(sizeof(void*) + 2 * sizeof(int) + sizeof(Value));
+}
@@ -0,0 +1,816 @@
+#include "posting_index.h"
+#include "memory_usage.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+void WriteVarint(vector<uint8_t>& data, uint32_t value) {
+    while (value >= 0x80) {
+        data.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(static_cast<uint8_t>(value));
+}
+
+// Читает count чисел varint и возвращает указатель за последним
+const uint8_t* ReadVarints(const uint8_t* data, size_t count, uint32_t* values) {
+    const uint64_t high_bits = 0x8080808080808080ull;
+    size_t i = 0;
+    while (i < count) {
+        // Коды частот и разности номеров в длинных списках обычно однобайтовые, поэтому восемь чисел
+        // подряд проверяются одним сравнением. Осталось не меньше восьми чисел, а значит, и байт блока
+        if (count - i >= 8) {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            if ((word & high_bits) == 0) {
+                for (size_t j = 0; j < 8; ++j) {
+                    values[i + j] = data[j];
+                }
+                data += 8;
+                i += 8;
+                continue;
+            }
+        }
+        uint32_t value = 0;
+        uint32_t shift = 0;
+        uint8_t byte;
+        do {
+            byte = *data++;
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        values[i++] = value;
+    }
+    return data;
+}
+
+// Читает count чисел varint, не заходя за end; nullptr, если числа не помещаются до end или в 32 бита
+const uint8_t* ReadVarintsChecked(const uint8_t* data, const uint8_t* end, size_t count, uint32_t* values) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t value = 0;
+        for (uint32_t shift = 0;; shift += 7) {
+            if (data == end || shift > 28) {
+                return nullptr;
+            }
+            const uint8_t byte = *data++;
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        values[i] = value;
+    }
+    return data;
+}
+
+// Декодирует все блоки сегмента из снимка с проверкой границ. Снимок мог быть загружен без проверки
+// контрольных сумм, а быстрое чтение блоков полагается на то, что числа блока лежат в данных сегмента,
+// номера документов возрастают и меньше document_count, а коды частот есть в кодовой книге
+bool IsValidSegment(const PostingSegment::Arrays& arrays, size_t document_count) {
+    uint32_t ordinals[POSTING_BLOCK_SIZE];
+    uint32_t codes[POSTING_BLOCK_SIZE];
+    const uint8_t* const end = arrays.data + arrays.data_size;
+    for (size_t term = 0; term < arrays.term_count; ++term) {
+        const PostingSegment::TermRange& range = arrays.ranges[term];
+        if (range.first_block > arrays.block_count || range.block_count > arrays.block_count - range.first_block) {
+            return false;
+        }
+        uint64_t size = 0;
+        uint64_t ordinal = 0;
+        uint64_t offset = range.block_count > 0 ? arrays.blocks[range.first_block].offset : 0;
+        for (size_t block = range.first_block; block < range.first_block + range.block_count; ++block) {
+            const PostingBlock& header = arrays.blocks[block];
+            // блоки слова лежат подряд: на этом держится перезапись слова при уплотнении
+            if (header.size == 0 || header.size > POSTING_BLOCK_SIZE || header.offset != offset || offset >= arrays.data_size) {
+                return false;
+            }
+            const uint8_t* data = ReadVarintsChecked(arrays.data + offset, end, header.size, ordinals);
+            data = data == nullptr ? nullptr : ReadVarintsChecked(data, end, header.size, codes);
+            if (data == nullptr) {
+                return false;
+            }
+            for (size_t i = 0; i < header.size; ++i) {
+                // разность 0 допустима только у первого постинга слова
+                if ((ordinals[i] == 0 && (size > 0 || i > 0)) || codes[i] >= arrays.term_freq_count) {
+                    return false;
+                }
+                ordinal += ordinals[i];
+            }
+            if (ordinal >= document_count || ordinal != header.last_ordinal) {
+                return false;
+            }
+            size += header.size;
+            offset = data - arrays.data;
+        }
+        if (size != range.size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Дописывает постинги слова блоками в data и blocks
+PostingSegment::TermRange EncodePostings(const uint32_t* ordinals, const uint32_t* codes, size_t size,
+                                         vector<uint8_t>& data, vector<PostingBlock>& blocks) {
+    const PostingSegment::TermRange range{blocks.size(), static_cast<uint32_t>((size + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE),
+                                          static_cast<uint32_t>(size)};
+    uint32_t previous_ordinal = 0;
+    for (size_t first = 0; first < size; first += POSTING_BLOCK_SIZE) {
+        const size_t last = min(size, first + POSTING_BLOCK_SIZE);
+        blocks.push_back({data.size(), ordinals[last - 1], static_cast<uint32_t>(last - first)});
+        for (size_t i = first; i < last; ++i) {
+            WriteVarint(data, ordinals[i] - previous_ordinal);
+            previous_ordinal = ordinals[i];
+        }
+        for (size_t i = first; i < last; ++i) {
+            WriteVarint(data, codes[i]);
+        }
+    }
+    return range;
+}
+
+// Собирает массивы сегмента слово за словом. Коды частот назначаются по убыванию встречаемости
+class SegmentEncoder {
+public:
+    explicit SegmentEncoder(const unordered_map<double, size_t>& term_freq_counts) {
+        vector<pair<double, size_t>> values(term_freq_counts.begin(), term_freq_counts.end());
+        sort(values.begin(), values.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.second != rhs.second ? lhs.second > rhs.second : lhs.first < rhs.first;
+        });
+        codes_.reserve(values.size());
+        term_freqs.reserve(values.size());
+        for (const auto& [term_freq, _] : values) {
+            codes_.emplace(term_freq, static_cast<uint32_t>(term_freqs.size()));
+            term_freqs.push_back(term_freq);
+        }
+    }
+
+    uint32_t GetCode(double term_freq) const {
+        return codes_.at(term_freq);
+    }
+
+    // Слова добавляются по порядку номеров
+    void AddTerm(const vector<uint32_t>& ordinals, const vector<uint32_t>& codes) {
+        ranges.push_back(EncodePostings(ordinals.data(), codes.data(), ordinals.size(), data, blocks));
+    }
+
+    vector<uint8_t> data;
+    vector<PostingBlock> blocks;
+    vector<PostingSegment::TermRange> ranges;
+    vector<double> term_freqs;
+
+private:
+    unordered_map<double, uint32_t> codes_;
+};
+
+PostingSegment::Arrays GetSnapshotArrays(const SnapshotReader& reader) {
+    PostingSegment::Arrays arrays;
+    tie(arrays.data, arrays.data_size) = reader.GetSection<uint8_t>(SnapshotSection::POSTING_DATA);
+    tie(arrays.blocks, arrays.block_count) = reader.GetSection<PostingBlock>(SnapshotSection::POSTING_BLOCKS);
+    tie(arrays.ranges, arrays.term_count) = reader.GetSection<PostingSegment::TermRange>(SnapshotSection::POSTING_RANGES);
+    tie(arrays.term_freqs, arrays.term_freq_count) = reader.GetSection<const double>(SnapshotSection::POSTING_TERM_FREQS);
+    return arrays;
+}
+
+} // namespace
+
+void DecodePostingBlock(const CompressedPostingList& postings, size_t block, uint32_t* ordinals, uint32_t* codes) {
+    const PostingBlock& header = postings.blocks[block];
+    const uint8_t* data = ReadVarints(postings.data + header.offset, header.size, ordinals);
+    uint32_t ordinal = block == 0 ? 0 : postings.blocks[block - 1].last_ordinal;
+    for (size_t i = 0; i < header.size; ++i) {
+        ordinal += ordinals[i];
+        ordinals[i] = ordinal;
+    }
+    ReadVarints(data, header.size, codes);
+}
+
+
+PostingSegment::PostingSegment(const PostingLists& postings) {
+    unordered_map<double, size_t> term_freq_counts;
+    for (const auto& term_postings : postings) {
+        for (const Posting& posting : term_postings) {
+            ++term_freq_counts[posting.term_freq];
+        }
+    }
+    SegmentEncoder encoder(term_freq_counts);
+    vector<uint32_t> ordinals;
+    vector<uint32_t> codes;
+    for (const auto& term_postings : postings) {
+        ordinals.clear();
+        codes.clear();
+        for (const Posting& posting : term_postings) {
+            ordinals.push_back(posting.ordinal);
+            codes.push_back(encoder.GetCode(posting.term_freq));
+        }
+        encoder.AddTerm(ordinals, codes);
+    }
+    Own(move(encoder.data), move(encoder.blocks), move(encoder.ranges), move(encoder.term_freqs));
+}
+
+PostingSegment::PostingSegment(const Arrays& arrays)
+    : arrays_(arrays) {
+    for (size_t term = 0; term < arrays_.term_count; ++term) {
+        posting_count_ += arrays_.ranges[term].size;
+    }
+}
+
+PostingSegment::PostingSegment(const PostingSegment& other) {
+    *this = other;
+}
+
+PostingSegment& PostingSegment::operator=(const PostingSegment& other) {
+    if (this != &other) {
+        const Arrays& arrays = other.arrays_;
+        Own({arrays.data, arrays.data + arrays.data_size}, {arrays.blocks, arrays.blocks + arrays.block_count},
+            {arrays.ranges, arrays.ranges + arrays.term_count}, {arrays.term_freqs, arrays.term_freqs + arrays.term_freq_count});
+        posting_count_ = other.posting_count_;
+    }
+    return *this;
+}
+
+void PostingSegment::Own(vector<uint8_t> data, vector<PostingBlock> blocks, vector<TermRange> ranges, vector<double> term_freqs) {
+    owned_data_ = move(data);
+    owned_blocks_ = move(blocks);
+    owned_ranges_ = move(ranges);
+    owned_term_freqs_ = move(term_freqs);
+    arrays_ = {owned_data_.data(), owned_data_.size(), owned_blocks_.data(), owned_blocks_.size(),
+               owned_ranges_.data(), owned_ranges_.size(), owned_term_freqs_.data(), owned_term_freqs_.size()};
+    posting_count_ = 0;
+    for (const TermRange& range : owned_ranges_) {
+        posting_count_ += range.size;
+    }
+}
+
+CompressedPostingList PostingSegment::Find(TermId term) const {
+    if (term >= arrays_.term_count) {
+        return {};
+    }
+    const TermRange& range = arrays_.ranges[term];
+    return {arrays_.blocks + range.first_block, range.block_count, range.size, arrays_.data, arrays_.term_freqs};
+}
+
+size_t PostingSegment::GetPostingCount() const {
+    return posting_count_;
+}
+
+size_t PostingSegment::GetTermCount() const {
+    return arrays_.term_count;
+}
+
+size_t PostingSegment::GetMemoryUsage() const {
+    return GetHeapSize(owned_data_) + GetHeapSize(owned_blocks_) + GetHeapSize(owned_ranges_) + GetHeapSize(owned_term_freqs_);
+}
+
+const PostingSegment::Arrays& PostingSegment::GetArrays() const {
+    return arrays_;
+}
+
+void PostingSegment::DecodeTerm(TermId term, vector<uint32_t>& ordinals, vector<uint32_t>& codes) const {
+    const CompressedPostingList postings = Find(term);
+    ordinals.resize(postings.size);
+    codes.resize(postings.size);
+    size_t position = 0;
+    for (size_t block = 0; block < postings.block_count; ++block) {
+        DecodePostingBlock(postings, block, ordinals.data() + position, codes.data() + position);
+        position += postings.blocks[block].size;
+    }
+}
+
+void PostingSegment::RewriteTerm(TermId term, const vector<uint32_t>& ordinals, const vector<uint32_t>& codes) {
+    TermRange& range = arrays_.ranges[term];
+    static thread_local vector<uint8_t> data;
+    static thread_local vector<PostingBlock> blocks;
+    data.clear();
+    blocks.clear();
+    const TermRange new_range = EncodePostings(ordinals.data(), codes.data(), ordinals.size(), data, blocks);
+    const uint64_t offset = arrays_.blocks[range.first_block].offset;
+    copy(data.begin(), data.end(), arrays_.data + offset);
+    for (size_t block = 0; block < blocks.size(); ++block) {
+        arrays_.blocks[range.first_block + block] = {offset + blocks[block].offset, blocks[block].last_ordinal, blocks[block].size};
+    }
+    range.block_count = new_range.block_count;
+    range.size = new_range.size;
+}
+
+PostingSegment PostingSegment::Merge(const PostingSegment& lhs, const PostingSegment& rhs) {
+    const size_t term_count = max(lhs.arrays_.term_count, rhs.arrays_.term_count);
+    vector<uint32_t> ordinals;
+    vector<uint32_t> codes;
+
+    // Кодовые книги сегментов разные, поэтому частоты перекодируются. Сначала считается, как часто
+    // встречается каждый код, чтобы объединённая книга тоже шла по убыванию встречаемости
+    vector<size_t> lhs_code_counts(lhs.arrays_.term_freq_count, 0);
+    vector<size_t> rhs_code_counts(rhs.arrays_.term_freq_count, 0);
+    for (TermId term = 0; term < term_count; ++term) {
+        lhs.DecodeTerm(term, ordinals, codes);
+        for (const uint32_t code : codes) {
+            ++lhs_code_counts[code];
+        }
+        rhs.DecodeTerm(term, ordinals, codes);
+        for (const uint32_t code : codes) {
+            ++rhs_code_counts[code];
+        }
+    }
+    unordered_map<double, size_t> term_freq_counts;
+    for (size_t code = 0; code < lhs_code_counts.size(); ++code) {
+        if (lhs_code_counts[code] > 0) {
+            term_freq_counts[lhs.arrays_.term_freqs[code]] += lhs_code_counts[code];
+        }
+    }
+    for (size_t code = 0; code < rhs_code_counts.size(); ++code) {
+        if (rhs_code_counts[code] > 0) {
+            term_freq_counts[rhs.arrays_.term_freqs[code]] += rhs_code_counts[code];
+        }
+    }
+    SegmentEncoder encoder(term_freq_counts);
+    const auto make_new_codes = [&encoder](const PostingSegment& segment, const vector<size_t>& code_counts) {
+        vector<uint32_t> new_codes(code_counts.size(), 0);
+        for (size_t code = 0; code < code_counts.size(); ++code) {
+            if (code_counts[code] > 0) {
+                new_codes[code] = encoder.GetCode(segment.arrays_.term_freqs[code]);
+            }
+        }
+        return new_codes;
+    };
+    const vector<uint32_t> lhs_new_codes = make_new_codes(lhs, lhs_code_counts);
+    const vector<uint32_t> rhs_new_codes = make_new_codes(rhs, rhs_code_counts);
+
+    vector<uint32_t> rhs_ordinals;
+    vector<uint32_t> rhs_codes;
+    for (TermId term = 0; term < term_count; ++term) {
+        lhs.DecodeTerm(term, ordinals, codes);
+        for (uint32_t& code : codes) {
+            code = lhs_new_codes[code];
+        }
+        rhs.DecodeTerm(term, rhs_ordinals, rhs_codes);
+        ordinals.insert(ordinals.end(), rhs_ordinals.begin(), rhs_ordinals.end());
+        for (const uint32_t code : rhs_codes) {
+            codes.push_back(rhs_new_codes[code]);
+        }
+        encoder.AddTerm(ordinals, codes);
+    }
+    PostingSegment result;
+    result.Own(move(encoder.data), move(encoder.blocks), move(encoder.ranges), move(encoder.term_freqs));
+    return result;
+}
+
+
+void PostingCursor::AddList(CompressedPostingList postings) {
+    if (postings.size > 0) {
+        lists_.push_back({postings, {}});
+        if (lists_.size() == 1) {
+            LoadBlock(0);
+        }
+    }
+}
+
+void PostingCursor::AddList(PostingList postings) {
+    if (!postings.empty()) {
+        lists_.push_back({{}, postings});
+        if (lists_.size() == 1) {
+            LoadBlock(0);
+        }
+    }
+}
+
+size_t PostingCursor::SkipTo(uint32_t ordinal) {
+    size_t skipped = 0;
+    while (list_ < lists_.size()) {
+        const List& list = lists_[list_];
+        const size_t block_count = GetBlockCount(list);
+        if (GetBlockLastOrdinal(list, block_count - 1) < ordinal) {
+            skipped += (list.compressed.size > 0 ? list.compressed.size : list.postings.size()) - block_first_ - position_;
+            block_first_ = 0;
+            if (++list_ < lists_.size()) {
+                LoadBlock(0);
+            }
+            continue;
+        }
+        if (GetBlockLastOrdinal(list, block_) < ordinal) {
+            // последний блок списка не меньше ordinal, поэтому шаг не выходит за конец
+            size_t first = block_;
+            size_t step = 1;
+            while (first + step < block_count && GetBlockLastOrdinal(list, first + step) < ordinal) {
+                first += step;
+                step *= 2;
+            }
+            size_t last = min(first + step, block_count - 1);
+            ++first;
+            while (first < last) {
+                const size_t middle = first + (last - first) / 2;
+                if (GetBlockLastOrdinal(list, middle) < ordinal) {
+                    first = middle + 1;
+                } else {
+                    last = middle;
+                }
+            }
+            skipped += block_size_ - position_;
+            block_first_ += block_size_;
+            for (size_t block = block_ + 1; block < first; ++block) {
+                skipped += list.compressed.blocks[block].size;
+                block_first_ += list.compressed.blocks[block].size;
+            }
+            LoadBlock(first);
+        }
+
+        // последний постинг блока не меньше ordinal
+        const Posting* postings = GetBlock();
+        size_t first = position_;
+        size_t step = 1;
+        while (first + step < block_size_ && postings[first + step].ordinal < ordinal) {
+            first += step;
+            step *= 2;
+        }
+        const size_t last = min(first + step, block_size_ - 1) + 1;
+        const size_t position = lower_bound(postings + first, postings + last, ordinal, [](const Posting& posting, uint32_t value) {
+            return posting.ordinal < value;
+        }) - postings;
+        skipped += position - position_;
+        position_ = position;
+        break;
+    }
+    return skipped;
+}
+
+const Posting* PostingCursor::Get() const {
+    return list_ < lists_.size() ? GetBlock() + position_ : nullptr;
+}
+
+const Posting* PostingCursor::GetBlock() const {
+    const List& list = lists_[list_];
+    return list.compressed.size > 0 ? decoded_postings_ : list.postings.begin();
+}
+
+size_t PostingCursor::GetBlockCount(const List& list) {
+    return list.compressed.size > 0 ? list.compressed.block_count : 1;
+}
+
+uint32_t PostingCursor::GetBlockLastOrdinal(const List& list, size_t block) {
+    return list.compressed.size > 0 ? list.compressed.blocks[block].last_ordinal : list.postings[list.postings.size() - 1].ordinal;
+}
+
+void PostingCursor::LoadBlock(size_t block) {
+    const List& list = lists_[list_];
+    block_ = block;
+    position_ = 0;
+    if (list.compressed.size == 0) {
+        block_size_ = list.postings.size();
+        return;
+    }
+    uint32_t ordinals[POSTING_BLOCK_SIZE];
+    uint32_t codes[POSTING_BLOCK_SIZE];
+    DecodePostingBlock(list.compressed, block, ordinals, codes);
+    block_size_ = list.compressed.blocks[block].size;
+    for (size_t i = 0; i < block_size_; ++i) {
+        decoded_postings_[i] = {ordinals[i], list.compressed.term_freqs[codes[i]]};
+    }
+}
+
+void PostingCursor::NextBlock() {
+    block_first_ += block_size_;
+    if (block_ + 1 < GetBlockCount(lists_[list_])) {
+        LoadBlock(block_ + 1);
+        return;
+    }
+    block_first_ = 0;
+    if (++list_ < lists_.size()) {
+        LoadBlock(0);
+    }
+}
+
+
+void PostingIndex::AddDocument(uint32_t ordinal, const unordered_map<TermId, double>& term_freqs) {
+    for (const auto& [term, term_freq] : term_freqs) {
+        if (term >= buffer_.size()) {
+            buffer_.resize(term + 1);
+        }
+        if (term >= document_freqs_.size()) {
+            document_freqs_.resize(term + 1, 0);
+        }
+        if (term >= max_term_freqs_.size()) {
+            max_term_freqs_.resize(term + 1, 0.0);
+            log_document_freqs_.resize(term + 1, 0.0);
+        }
+        auto& term_postings = buffer_[term];
+        const size_t capacity = term_postings.capacity();
+        term_postings.push_back({ordinal, term_freq});
+        if (term_postings.capacity() != capacity) {
+            buffer_posting_bytes_ += GetHeapSize(term_postings) - GetHeapBlockSize(capacity * sizeof(Posting));
+        }
+        log_document_freqs_[term] = log(++document_freqs_[term]);
+        max_term_freqs_[term] = max(max_term_freqs_[term], term_freq);
+    }
+    stored_posting_count_ += term_freqs.size();
+    if (++buffer_document_count_ >= BUFFER_DOCUMENT_LIMIT) {
+        Flush();
+    }
+}
+
+size_t PostingIndex::GetDocumentFreq(TermId term) const {
+    return term < document_freqs_.size() ? document_freqs_[term] : 0;
+}
+
+size_t PostingIndex::GetPostingCount() const {
+    return stored_posting_count_ - removed_posting_count_;
+}
+
+size_t PostingIndex::GetMemoryUsage(const PostingIndex* counted) const {
+    size_t bytes = GetHeapSize(segments_) + GetHeapSize(document_freqs_) + GetHeapSize(log_document_freqs_)
+        + GetHeapSize(max_term_freqs_) + GetHeapSize(removed_documents_);
+    for (const auto& segment : segments_) {
+        if (counted != nullptr && find(counted->segments_.begin(), counted->segments_.end(), segment) != counted->segments_.end()) {
+            continue;
+        }
+        bytes += GetSharedBlockSize<PostingSegment>() + segment->GetMemoryUsage();
+    }
+    return bytes;
+}
+
+size_t PostingIndex::GetBufferMemoryUsage() const {
+    size_t bytes = GetHeapSize(buffer_) + buffer_posting_bytes_ + GetHeapSize(sealed_buffers_);
+    for (const auto& buffer : sealed_buffers_) {
+        bytes += GetSharedBlockSize<SealedBuffer>() + GetHeapSize(buffer->postings) + buffer->posting_bytes;
+    }
+    return bytes;
+}
+
+double PostingIndex::GetLogDocumentFreq(TermId term) const {
+    return log_document_freqs_[term];
+}
+
+double PostingIndex::GetMaxTermFreq(TermId term) const {
+    return term < max_term_freqs_.size() ? max_term_freqs_[term] : 0.0;
+}
+
+PostingCursor PostingIndex::GetCursor(TermId term) const {
+    PostingCursor cursor;
+    for (const auto& segment : segments_) {
+        cursor.AddList(segment->Find(term));
+    }
+    for (const auto& buffer : sealed_buffers_) {
+        if (term < buffer->postings.size()) {
+            const vector<Posting>& postings = buffer->postings[term];
+            cursor.AddList(PostingList{postings.data(), postings.data() + postings.size()});
+        }
+    }
+    if (term < buffer_.size()) {
+        cursor.AddList(PostingList{buffer_[term].data(), buffer_[term].data() + buffer_[term].size()});
+    }
+    return cursor;
+}
+
+double PostingIndex::GetTermFreq(TermId term, uint32_t ordinal) const {
+    // номера документов растут от сегмента к сегменту и к буферу, поэтому декодируется один блок
+    for (const auto& segment : segments_) {
+        const CompressedPostingList postings = segment->Find(term);
+        if (postings.size == 0 || postings.blocks[postings.block_count - 1].last_ordinal < ordinal) {
+            continue;
+        }
+        const size_t block = partition_point(postings.blocks, postings.blocks + postings.block_count, [ordinal](const PostingBlock& header) {
+            return header.last_ordinal < ordinal;
+        }) - postings.blocks;
+        const PostingBlock& header = postings.blocks[block];
+        uint32_t deltas[POSTING_BLOCK_SIZE];
+        const uint8_t* data = ReadVarints(postings.data + header.offset, header.size, deltas);
+        uint32_t current = block == 0 ? 0 : postings.blocks[block - 1].last_ordinal;
+        size_t position = 0;
+        while ((current += deltas[position]) < ordinal) {
+            ++position;
+        }
+        // коды нужны только до найденного постинга
+        uint32_t codes[POSTING_BLOCK_SIZE];
+        ReadVarints(data, position + 1, codes);
+        return postings.term_freqs[codes[position]];
+    }
+    const auto find_in_buffer = [ordinal](const vector<Posting>& postings) {
+        return partition_point(postings.begin(), postings.end(), [ordinal](const Posting& posting) {
+            return posting.ordinal < ordinal;
+        })->term_freq;
+    };
+    for (const auto& buffer : sealed_buffers_) {
+        if (term < buffer->postings.size() && !buffer->postings[term].empty() && buffer->postings[term].back().ordinal >= ordinal) {
+            return find_in_buffer(buffer->postings[term]);
+        }
+    }
+    return find_in_buffer(buffer_[term]);
+}
+
+void PostingIndex::Validate(const SnapshotReader& reader, size_t document_count, size_t term_count) {
+    const auto [document_freqs, document_freq_count] = reader.GetSection<uint64_t>(SnapshotSection::DOCUMENT_FREQS);
+    const PostingSegment::Arrays arrays = GetSnapshotArrays(reader);
+    if (arrays.term_count != term_count || document_freq_count != term_count || !IsValidSegment(arrays, document_count)) {
+        throw invalid_argument("Snapshot posting index is corrupted"s);
+    }
+    // в снимке нет удалённых документов, поэтому частота слова - это длина его списка
+    for (size_t term = 0; term < term_count; ++term) {
+        if (document_freqs[term] != arrays.ranges[term].size) {
+            throw invalid_argument("Snapshot posting index is corrupted"s);
+        }
+    }
+}
+
+void PostingIndex::Flush() {
+    if (buffer_document_count_ == 0) {
+        return;
+    }
+    auto buffer = make_shared<SealedBuffer>();
+    buffer->posting_bytes = buffer_posting_bytes_;
+    const size_t term_count = buffer_.size();
+    buffer->postings = move(buffer_);
+    sealed_buffers_.push_back(move(buffer));
+    buffer_.clear();
+    buffer_.reserve(term_count);
+    buffer_document_count_ = 0;
+    buffer_posting_bytes_ = 0;
+
+    if (sealed_buffers_.size() > SEALED_BUFFER_LIMIT) {
+        // сжатие в фоне не успевает, например при добавлении большого пакета: писатель сжимает буфер
+        // сам, в каждой копии индекса, зато память под несжатые постинги остаётся ограниченной
+        segments_.push_back(make_shared<PostingSegment>(sealed_buffers_.front()->postings));
+        sealed_buffers_.erase(sealed_buffers_.begin());
+        ++buffers_version_;
+    }
+}
+
+PostingIndex::SegmentMerge PostingIndex::PlanMerge() const {
+    // Сегменты упорядочены от старых к новым; хвост сливается, пока предыдущий сегмент
+    // не станет заметно больше слитых за ним
+    SegmentMerge merge;
+    if (!sealed_buffers_.empty()) {
+        merge.buffers = sealed_buffers_;
+        merge.version = buffers_version_;
+        return merge;
+    }
+    if (segments_.empty()) {
+        return merge;
+    }
+    size_t first_segment = segments_.size() - 1;
+    size_t merged_posting_count = segments_.back()->GetPostingCount();
+    while (first_segment > 0 && segments_[first_segment - 1]->GetPostingCount() <= 2 * merged_posting_count) {
+        --first_segment;
+        merged_posting_count += segments_[first_segment]->GetPostingCount();
+    }
+    if (first_segment + 1 < segments_.size()) {
+        merge.first_segment = first_segment;
+        merge.segments.assign(segments_.begin() + first_segment, segments_.end());
+        merge.version = segments_version_;
+    }
+    return merge;
+}
+
+shared_ptr<PostingSegment> PostingIndex::BuildMerge(const SegmentMerge& merge) {
+    // соседние сегменты сливаются попарно, пока не останется один: большой пакет добавлений оставляет
+    // много мелких сегментов, и каждый постинг копируется O(log) раз, а не при каждом слиянии
+    vector<shared_ptr<PostingSegment>> segments = merge.segments;
+    for (const auto& buffer : merge.buffers) {
+        segments.push_back(make_shared<PostingSegment>(buffer->postings));
+    }
+    while (segments.size() > 1) {
+        size_t merged_count = 0;
+        for (size_t i = 0; i < segments.size(); i += 2) {
+            segments[merged_count++] = i + 1 < segments.size() ? make_shared<PostingSegment>(PostingSegment::Merge(*segments[i], *segments[i + 1])) : segments[i];
+        }
+        segments.resize(merged_count);
+    }
+    return segments.front();
+}
+
+void PostingIndex::ApplyMerge(const SegmentMerge& merge, const shared_ptr<PostingSegment>& merged) {
+    // после PlanMerge сегменты и буферы, которые версия не отметила, могли только добавиться в конец
+    if (!merge.buffers.empty() && merge.version == buffers_version_) {
+        segments_.push_back(merged);
+        sealed_buffers_.erase(sealed_buffers_.begin(), sealed_buffers_.begin() + merge.buffers.size());
+        ++buffers_version_;
+    } else if (!merge.segments.empty() && merge.version == segments_version_) {
+        segments_.erase(segments_.begin() + merge.first_segment + 1, segments_.begin() + merge.first_segment + merge.segments.size());
+        segments_[merge.first_segment] = merged;
+        ++segments_version_;
+    }
+}
+
+void PostingIndex::Compact(ThreadPool* thread_pool) {
+    if (removed_posting_count_ == 0) {
+        return;
+    }
+    // общие сегменты и буферы читают другая копия индекса или слияние, поэтому уплотняется своя копия
+    for (auto& segment : segments_) {
+        if (segment.use_count() > 1) {
+            segment = make_shared<PostingSegment>(*segment);
+        }
+    }
+    for (auto& buffer : sealed_buffers_) {
+        if (buffer.use_count() > 1) {
+            auto copy = make_shared<SealedBuffer>(*buffer);
+            copy->posting_bytes = 0;
+            for (const vector<Posting>& postings : copy->postings) {
+                copy->posting_bytes += GetHeapSize(postings);
+            }
+            buffer = move(copy);
+        }
+    }
+    ++segments_version_;
+    ++buffers_version_;
+    // CompactTerm меняет только участки своего слова, поэтому гонок между потоками нет
+    const size_t term_count = max(document_freqs_.size(), buffer_.size());
+    const size_t block_count = (term_count + COMPACTION_BLOCK_SIZE - 1) / COMPACTION_BLOCK_SIZE;
+    ForEachIndex(thread_pool, block_count, [this, term_count](size_t block) {
+        const size_t last_term = min(term_count, (block + 1) * COMPACTION_BLOCK_SIZE);
+        for (size_t term = block * COMPACTION_BLOCK_SIZE; term < last_term; ++term) {
+            CompactTerm(static_cast<TermId>(term));
+        }
+    });
+    stored_posting_count_ -= removed_posting_count_;
+    removed_posting_count_ = 0;
+}
+
+void PostingIndex::CompactIfNeeded(ThreadPool* thread_pool) {
+    if (removed_posting_count_ * COMPACTION_REMOVED_SHARE >= stored_posting_count_ && removed_posting_count_ > 0) {
+        Compact(thread_pool);
+    }
+}
+
+void PostingIndex::CompactTerm(TermId term) {
+    const auto is_removed = [this](uint32_t ordinal) {
+        return IsRemoved(ordinal);
+    };
+    for (const auto& segment : segments_) {
+        segment->ErasePostingsIf(term, is_removed);
+    }
+    const auto erase_removed = [&is_removed, term](PostingSegment::PostingLists& buffer) {
+        if (term < buffer.size()) {
+            auto& term_postings = buffer[term];
+            term_postings.erase(remove_if(term_postings.begin(), term_postings.end(), [&is_removed](const Posting& posting) {
+                return is_removed(posting.ordinal);
+            }), term_postings.end());
+        }
+    };
+    for (const auto& buffer : sealed_buffers_) {
+        erase_removed(buffer->postings);
+    }
+    erase_removed(buffer_);
+    // после удаления постингов граница снова точная
+    if (term < max_term_freqs_.size()) {
+        double max_term_freq = 0.0;
+        ForEachPosting(term, [&max_term_freq](const Posting& posting) {
+            max_term_freq = max(max_term_freq, posting.term_freq);
+        });
+        max_term_freqs_[term] = max_term_freq;
+    }
+}
+
+void PostingIndex::Save(SnapshotWriter& writer, size_t term_count, const vector<uint32_t>& new_ordinals) const {
+    PostingSegment::PostingLists postings(term_count);
+    vector<uint64_t> document_freqs(term_count);
+    vector<double> max_term_freqs(term_count, 0.0);
+    for (TermId term = 0; term < term_count; ++term) {
+        ForEachPosting(term, [&](const Posting& posting) {
+            if (new_ordinals[posting.ordinal] != NO_ORDINAL) {
+                postings[term].push_back({new_ordinals[posting.ordinal], posting.term_freq});
+                max_term_freqs[term] = max(max_term_freqs[term], posting.term_freq);
+            }
+        });
+        document_freqs[term] = postings[term].size();
+    }
+    const PostingSegment segment(postings);
+    postings.clear();
+    const PostingSegment::Arrays& arrays = segment.GetArrays();
+    writer.WriteSection(SnapshotSection::DOCUMENT_FREQS, document_freqs);
+    writer.WriteSection(SnapshotSection::MAX_TERM_FREQS, max_term_freqs);
+    writer.WriteSection(SnapshotSection::POSTING_DATA, reinterpret_cast<const char*>(arrays.data), arrays.data_size);
+    writer.WriteSection(SnapshotSection::POSTING_BLOCKS, reinterpret_cast<const char*>(arrays.blocks), arrays.block_count * sizeof(PostingBlock));
+    writer.WriteSection(SnapshotSection::POSTING_RANGES, reinterpret_cast<const char*>(arrays.ranges), arrays.term_count * sizeof(PostingSegment::TermRange));
+    writer.WriteSection(SnapshotSection::POSTING_TERM_FREQS, reinterpret_cast<const char*>(arrays.term_freqs), arrays.term_freq_count * sizeof(double));
+}
+
+void PostingIndex::Load(const SnapshotReader& reader) {
+    const auto [document_freqs, term_count] = reader.GetSection<uint64_t>(SnapshotSection::DOCUMENT_FREQS);
+    const auto [max_term_freqs, max_term_freq_count] = reader.GetSection<double>(SnapshotSection::MAX_TERM_FREQS);
+    const PostingSegment::Arrays arrays = GetSnapshotArrays(reader);
+    if (arrays.term_count != term_count || max_term_freq_count != term_count) {
+        throw invalid_argument("Snapshot posting index is corrupted"s);
+    }
+
+    segments_.clear();
+    segments_.push_back(make_shared<PostingSegment>(arrays));
+    sealed_buffers_.clear();
+    ++segments_version_;
+    ++buffers_version_;
+    buffer_.clear();
+    buffer_document_count_ = 0;
+    buffer_posting_bytes_ = 0;
+    document_freqs_.assign(document_freqs, document_freqs + term_count);
+    log_document_freqs_.resize(term_count);
+    for (size_t term = 0; term < term_count; ++term) {
+        log_document_freqs_[term] = log(document_freqs_[term]);
+    }
+    max_term_freqs_.assign(max_term_freqs, max_term_freqs + term_count);
+    removed_documents_.clear();
+    stored_posting_count_ = segments_.back()->GetPostingCount();
+    removed_posting_count_ = 0;
+}
@@ -0,0 +1,375 @@
+#pragma once
+
+#include "array_view.h"
+#include "document.h"
+#include "small_vector.h"
+#include "snapshot.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct Posting {
+    uint32_t ordinal;
+    double term_freq;
+};
+
+// Непрерывный участок постингов одного слова, отсортированный по внутреннему номеру документа
+using PostingList = ArrayView<Posting>;
+
+// Постингов в одном сжатом блоке
+const size_t POSTING_BLOCK_SIZE = 128;
+
+// Сжатый блок: сначала разности номеров документов (первая - с последним номером предыдущего блока слова
+// или с нулём), затем коды частот, всё в varint. offset - начало блока в данных сегмента
+struct PostingBlock {
+    uint64_t offset;
+    uint32_t last_ordinal;
+    uint32_t size;
+};
+
+// Сжатые постинги одного слова в сегменте. Частота постинга с кодом c равна term_freqs[c]
+struct CompressedPostingList {
+    const PostingBlock* blocks = nullptr;
+    size_t block_count = 0;
+    size_t size = 0;
+    const uint8_t* data = nullptr;
+    const double* term_freqs = nullptr;
+};
+
+// Декодирует блок block списка: номера документов - в ordinals, коды частот - в codes
+void DecodePostingBlock(const CompressedPostingList& postings, size_t block, uint32_t* ordinals, uint32_t* codes);
+
+// Неизменяемый сегмент: постинги всех слов сжаты блоками в одном массиве, для каждого слова хранится
+// его участок блоков. Частота слова в документе - это доля вида k / n, различных долей немного,
+// поэтому постинг хранит не частоту, а её код в кодовой книге сегмента; частые значения получают
+// однобайтовые коды. Массивы принадлежат сегменту либо лежат в отображённом файле снимка
+class PostingSegment {
+public:
+    // Списки постингов, индексируемые номером слова
+    using PostingLists = std::vector<std::vector<Posting>>;
+
+    struct TermRange {
+        uint64_t first_block;
+        uint32_t block_count;
+        uint32_t size;
+    };
+
+    // Массивы сегмента в том виде, в каком они лежат в снимке
+    struct Arrays {
+        uint8_t* data = nullptr;
+        size_t data_size = 0;
+        PostingBlock* blocks = nullptr;
+        size_t block_count = 0;
+        TermRange* ranges = nullptr;
+        size_t term_count = 0;
+        const double* term_freqs = nullptr;
+        size_t term_freq_count = 0;
+    };
+
+    PostingSegment() = default;
+
+    explicit PostingSegment(const PostingLists& postings);
+
+    explicit PostingSegment(const Arrays& arrays);
+
+    // Копия всегда владеет своими массивами
+    PostingSegment(const PostingSegment& other);
+    PostingSegment& operator=(const PostingSegment& other);
+
+    PostingSegment(PostingSegment&&) noexcept = default;
+    PostingSegment& operator=(PostingSegment&&) noexcept = default;
+
+    CompressedPostingList Find(TermId term) const;
+
+    size_t GetPostingCount() const;
+
+    // Все документы lhs должны иметь меньшие номера, чем документы rhs
+    static PostingSegment Merge(const PostingSegment& lhs, const PostingSegment& rhs);
+
+    // Сегмент закрыт для добавления, но уплотнение индекса убирает постинги удалённых документов:
+    // постинги слова с predicate(ordinal) == true выбрасываются, остальные сжимаются на прежнее место.
+    // Участки слов не пересекаются, поэтому разные слова можно обрабатывать параллельно
+    template <typename Predicate>
+    void ErasePostingsIf(TermId term, Predicate predicate);
+
+    size_t GetTermCount() const;
+
+    // Массивы сегмента для записи в снимок
+    const Arrays& GetArrays() const;
+
+    // Память в куче со служебными данными распределителя; массивы из снимка в неё не входят
+    size_t GetMemoryUsage() const;
+
+private:
+    std::vector<uint8_t> owned_data_;
+    std::vector<PostingBlock> owned_blocks_;
+    std::vector<TermRange> owned_ranges_;
+    std::vector<double> owned_term_freqs_;
+    Arrays arrays_;
+    size_t posting_count_ = 0;
+
+    void Own(std::vector<uint8_t> data, std::vector<PostingBlock> blocks, std::vector<TermRange> ranges, std::vector<double> term_freqs);
+
+    // Номера документов и коды частот всех постингов слова
+    void DecodeTerm(TermId term, std::vector<uint32_t>& ordinals, std::vector<uint32_t>& codes) const;
+
+    // Записывает постинги слова на место прежних. Разность номеров после выброшенных постингов
+    // занимает не больше байт, чем выброшенные разности вместе с ней, поэтому новые блоки помещаются
+    void RewriteTerm(TermId term, const std::vector<uint32_t>& ordinals, const std::vector<uint32_t>& codes);
+};
+
+// Постинги слова во всех сегментах и в буфере. Списки идут по возрастанию номеров документов,
+// поэтому курсор обходит их как один отсортированный список и движется только вперёд.
+// Сжатые списки декодируются по блоку, блоки целиком до нужного номера пропускаются без декодирования
+class PostingCursor {
+public:
+    void AddList(CompressedPostingList postings);
+
+    void AddList(PostingList postings);
+
+    // Встаёт на первый постинг с номером не меньше ordinal; возвращает число пройденных постингов.
+    // Ищет экспоненциальным шагом от текущей позиции, поэтому короткие сдвиги дешёвые
+    size_t SkipTo(uint32_t ordinal);
+
+    // Текущий постинг или nullptr, если постинги кончились
+    const Posting* Get() const;
+
+    // Вызывает callback для постингов с номерами меньше last_ordinal и встаёт за ними
+    template <typename Callback>
+    void ForEachBefore(uint32_t last_ordinal, Callback callback);
+
+private:
+    static const size_t INLINE_LIST_COUNT = 8;
+
+    // Несжатый список из буфера индекса считается одним уже декодированным блоком
+    struct List {
+        CompressedPostingList compressed;
+        PostingList postings;
+    };
+
+    SmallVector<List, INLINE_LIST_COUNT> lists_;
+    size_t list_ = 0;
+    size_t block_ = 0;
+    // постингов текущего списка в блоках до текущего
+    size_t block_first_ = 0;
+    size_t block_size_ = 0;
+    size_t position_ = 0;
+    Posting decoded_postings_[POSTING_BLOCK_SIZE];
+
+    // Постинги текущего блока
+    const Posting* GetBlock() const;
+
+    static size_t GetBlockCount(const List& list);
+
+    static uint32_t GetBlockLastOrdinal(const List& list, size_t block);
+
+    void LoadBlock(size_t block);
+
+    // Переходит в начало следующего блока или списка
+    void NextBlock();
+};
+
+// Инвертированный индекс из сегментов: AddDocument пишет в небольшой изменяемый буфер,
+// заполненный буфер закрывается для добавления и позже сжимается в сегмент, сегменты близкого размера
+// сливаются. Сжатие и слияние не делаются при добавлении: их планирует PlanMerge, сегмент строит
+// BuildMerge вне блокировок, а ApplyMerge ставит его в обе копии индекса, и копии делят его
+class PostingIndex {
+public:
+    // Заполненный буфер, который ждёт сжатия в сегмент; запросы читают его как есть
+    struct SealedBuffer {
+        PostingSegment::PostingLists postings;
+        // массивы постингов в postings
+        size_t posting_bytes = 0;
+    };
+
+    // Либо сжатие первых закрытых буферов в сегмент, который встанет за всеми сегментами,
+    // либо слияние подряд идущих сегментов, начиная с first_segment
+    struct SegmentMerge {
+        std::vector<std::shared_ptr<SealedBuffer>> buffers;
+        size_t first_segment = 0;
+        std::vector<std::shared_ptr<PostingSegment>> segments;
+        // ApplyMerge сверяет его с индексом: после уплотнения сегменты и буферы уже другие
+        uint64_t version = 0;
+    };
+
+    // Документы добавляются в порядке возрастания номеров
+    void AddDocument(uint32_t ordinal, const std::unordered_map<TermId, double>& term_freqs);
+
+    // Помечает документ удалённым за O(1) на слово: постинги остаются до уплотнения,
+    // но больше не обходятся, а частоты слов сразу учитывают удаление
+    template <typename Terms>
+    void RemoveDocument(uint32_t ordinal, const Terms& terms);
+
+    bool IsRemoved(uint32_t ordinal) const;
+
+    // Физически удаляет постинги удалённых документов; слова обрабатываются параллельно в thread_pool,
+    // если он передан
+    void Compact(ThreadPool* thread_pool);
+
+    // Уплотняет индекс, когда постинги удалённых документов составляют заметную долю всех постингов
+    void CompactIfNeeded(ThreadPool* thread_pool);
+
+    size_t GetDocumentFreq(TermId term) const;
+
+    // Постинги документов, которые не удалены
+    size_t GetPostingCount() const;
+
+    // Память сегментов и частот слов в куче со служебными данными распределителя.
+    // Сегменты, общие с counted, уже учтены в нём и не считаются повторно
+    size_t GetMemoryUsage(const PostingIndex* counted = nullptr) const;
+
+    // Память изменяемого буфера и закрытых буферов; считается при добавлении постингов, а не обходом буфера
+    size_t GetBufferMemoryUsage() const;
+
+    // Натуральный логарифм GetDocumentFreq, пересчитывается при изменении частоты, а не при каждом запросе
+    double GetLogDocumentFreq(TermId term) const;
+
+    // Верхняя граница term_freq по постингам слова. После удаления документов граница может быть
+    // завышена до уплотнения, но никогда не занижена
+    double GetMaxTermFreq(TermId term) const;
+
+    // Курсор не учитывает удаление: проверять документы нужно через IsRemoved
+    PostingCursor GetCursor(TermId term) const;
+
+    // Частота слова в документе, где оно встречается. Декодирует блок постингов, поэтому не для горячих путей
+    double GetTermFreq(TermId term, uint32_t ordinal) const;
+
+    // Вызывает callback для каждого постинга слова во всех сегментах и в буфере, пропуская удалённые документы
+    template <typename Callback>
+    void ForEachPosting(TermId term, Callback callback) const;
+
+    // Принудительно закрывает буфер для добавления. Если закрытых буферов накопилось больше
+    // SEALED_BUFFER_LIMIT, сжатие не успевает за добавлением, и самый старый буфер сжимается сразу
+    void Flush();
+
+    // Сначала сжатие закрытых буферов, затем слияние сегментов в конце списка: пока предыдущий сегмент
+    // не станет заметно больше слитых за ним, поэтому сегментов остаётся O(log N). Пустой план,
+    // если делать нечего; после каждого ApplyMerge план строится заново
+    SegmentMerge PlanMerge() const;
+
+    // Строит сегмент из сегментов или буферов плана; они не меняются, пока план их держит,
+    // поэтому вызывается без блокировок
+    static std::shared_ptr<PostingSegment> BuildMerge(const SegmentMerge& merge);
+
+    // Заменяет сегменты или буферы плана построенным сегментом. Если после PlanMerge индекс
+    // уплотнялся или буферы плана сжал Flush, план устарел и ничего не делает
+    void ApplyMerge(const SegmentMerge& merge, const std::shared_ptr<PostingSegment>& merged);
+
+    // В снимок попадает один сегмент; номера документов заменяются на new_ordinals[ordinal]
+    void Save(SnapshotWriter& writer, size_t term_count, const std::vector<uint32_t>& new_ordinals) const;
+
+    void Load(const SnapshotReader& reader);
+
+    // Декодирует все блоки снимка с проверкой границ: нужна, когда контрольные суммы не проверялись.
+    // Номера документов должны быть меньше document_count, номера слов - меньше term_count
+    static void Validate(const SnapshotReader& reader, size_t document_count, size_t term_count);
+
+private:
+    static const size_t BUFFER_DOCUMENT_LIMIT = 4096;
+    static const size_t SEALED_BUFFER_LIMIT = 4;
+    // уплотнение запускается, когда удалённые постинги составляют не меньше 1/COMPACTION_REMOVED_SHARE всех
+    static const size_t COMPACTION_REMOVED_SHARE = 4;
+    // слова раздаются потокам пула блоками, чтобы не платить за планирование каждого слова
+    static const size_t COMPACTION_BLOCK_SIZE = 256;
+
+    // Сегмент может быть общим для обеих копий индекса и для строящегося слияния, закрытый буфер -
+    // для слияния; такие сегменты и буферы не меняются на месте, а уплотнение заменяет их копиями.
+    // Новые ссылки на них появляются только у писателя индекса, поэтому единственный владелец
+    // остаётся единственным. Закрытые буферы новее всех сегментов
+    std::vector<std::shared_ptr<PostingSegment>> segments_;
+    std::vector<std::shared_ptr<SealedBuffer>> sealed_buffers_;
+    // растут, когда сегменты или закрытые буферы перестраиваются, а не только добавляются в конец
+    uint64_t segments_version_ = 0;
+    uint64_t buffers_version_ = 0;
+    PostingSegment::PostingLists buffer_;
+    size_t buffer_document_count_ = 0;
+    // массивы постингов в buffer_
+    size_t buffer_posting_bytes_ = 0;
+    std::vector<size_t> document_freqs_;
+    std::vector<double> log_document_freqs_;
+    std::vector<double> max_term_freqs_;
+    std::vector<uint64_t> removed_documents_;
+    size_t stored_posting_count_ = 0;
+    size_t removed_posting_count_ = 0;
+
+    void CompactTerm(TermId term);
+};
+
+
+template <typename Predicate>
+void PostingSegment::ErasePostingsIf(TermId term, Predicate predicate) {
+    if (term >= arrays_.term_count) {
+        return;
+    }
+    static thread_local std::vector<uint32_t> ordinals;
+    static thread_local std::vector<uint32_t> codes;
+    DecodeTerm(term, ordinals, codes);
+    size_t kept_count = 0;
+    for (size_t i = 0; i < ordinals.size(); ++i) {
+        if (!predicate(ordinals[i])) {
+            ordinals[kept_count] = ordinals[i];
+            codes[kept_count] = codes[i];
+            ++kept_count;
+        }
+    }
+    if (kept_count != ordinals.size()) {
+        ordinals.resize(kept_count);
+        codes.resize(kept_count);
+        RewriteTerm(term, ordinals, codes);
+    }
+}
+
+
+template <typename Terms>
+void PostingIndex::RemoveDocument(uint32_t ordinal, const Terms& terms) {
+    if (IsRemoved(ordinal)) {
+        return;
+    }
+    if (ordinal / 64 >= removed_documents_.size()) {
+        removed_documents_.resize(ordinal / 64 + 1, 0);
+    }
+    removed_documents_[ordinal / 64] |= uint64_t{1} << (ordinal % 64);
+    for (const TermId term : terms) {
+        log_document_freqs_[term] = std::log(--document_freqs_[term]);
+    }
+    removed_posting_count_ += terms.size();
+}
+
+inline bool PostingIndex::IsRemoved(uint32_t ordinal) const {
+    return ordinal / 64 < removed_documents_.size() && (removed_documents_[ordinal / 64] >> (ordinal % 64) & 1);
+}
+
+template <typename Callback>
+void PostingIndex::ForEachPosting(TermId term, Callback callback) const {
+    GetCursor(term).ForEachBefore(NO_ORDINAL, [this, &callback](const Posting& posting) {
+        if (!IsRemoved(posting.ordinal)) {
+            callback(posting);
+        }
+    });
+}
+
+template <typename Callback>
+void PostingCursor::ForEachBefore(uint32_t last_ordinal, Callback callback) {
+    while (list_ < lists_.size()) {
+        const Posting* postings = GetBlock();
+        if (postings[block_size_ - 1].ordinal >= last_ordinal) {
+            // последний постинг блока не меньше last_ordinal, поэтому цикл не выходит за конец блока
+            for (; postings[position_].ordinal < last_ordinal; ++position_) {
+                callback(postings[position_]);
+            }
+            return;
+        }
+        // блок целиком до last_ordinal, номера можно не сравнивать
+        for (; position_ < block_size_; ++position_) {
+            callback(postings[position_]);
+        }
+        NextBlock();
+    }
+}
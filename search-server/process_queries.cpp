@@ -2,7 +2,6 @@
 
 #include <algorithm>
 #include <numeric>
-#include <execution>
 #include <vector>
 #include <string>
 
@@ -12,10 +11,11 @@ vector<vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const vector<string>& queries) {
     
+    // запросы раздаются работникам по одному; под такой нагрузкой каждый запрос выполняется в одном потоке
     vector<vector<Document>> result(queries.size());
-    transform(execution::par, queries.begin(), queries.end(), result.begin(), [&search_server] (const string& query) {
-        return search_server.FindTopDocuments(query); 
-    }); 
+    search_server.GetThreadPool().ParallelFor(queries.size(), [&search_server, &queries, &result] (size_t i) {
+        result[i] = search_server.FindTopDocuments(queries[i]);
+    });
     return result;
 }
 
@@ -24,8 +24,8 @@ list<Document> ProcessQueriesJoined(const SearchServer& search_server, const vec
     vector<vector<Document>> res_of_queries = ProcessQueries(search_server, queries);
     size_t sz = res_of_queries.size();
     vector<list<Document>> lists(sz);
-    transform(std::execution::par, res_of_queries.begin(), res_of_queries.end(), lists.begin(), [] (const auto& res_of_query) {
-        return list(res_of_query.begin(), res_of_query.end()); 
+    search_server.GetThreadPool().ParallelFor(sz, [&res_of_queries, &lists] (size_t i) {
+        lists[i] = list(res_of_queries[i].begin(), res_of_queries[i].end());
     });
     
     list<Document> res_list;
@@ -33,4 +33,8 @@ list<Document> ProcessQueriesJoined(const SearchServer& search_server, const vec
         res_list.splice(res_list.end(), lists[i]);
     }
     return res_list; 
+}
+
+BatchResults ProcessQueriesBatch(const SearchServer& search_server, const vector<string>& queries) {
+    return search_server.FindTopDocumentsBatch(queries);
 } 
\ No newline at end of file
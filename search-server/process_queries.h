@@ -1,5 +1,6 @@
 #pragma once
 
+#include "batch_results.h"
 #include "document.h"
 #include "search_server.h"
 
@@ -12,3 +13,8 @@ std::vector<std::vector<Document>> ProcessQueries(
 std::list<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
+
+// Результаты всех запросов лежат в одном буфере; см. SearchServer::FindTopDocumentsBatch
+BatchResults ProcessQueriesBatch(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
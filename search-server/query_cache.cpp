@@ -0,0 +1,87 @@
+#include "query_cache.h"
+
+#include <chrono>
+#include <functional>
+
+using namespace std;
+
+double QueryCache::Stats::GetHitRate() const {
+    const uint64_t requests = hits + misses + coalesced;
+    return requests == 0 ? 0.0 : hits * 1.0 / requests;
+}
+
+QueryCache::QueryCache(size_t capacity) {
+    SetCapacity(capacity);
+}
+
+void QueryCache::SetCapacity(size_t capacity) {
+    shard_capacity_ = (capacity + SHARD_COUNT - 1) / SHARD_COUNT;
+    for (Shard& shard : shards_) {
+        lock_guard lock(shard.mutex);
+        shard.positions.clear();
+        shard.entries.clear();
+    }
+}
+
+bool QueryCache::IsEnabled() const {
+    return shard_capacity_.load() > 0;
+}
+
+QueryCache::Stats QueryCache::GetStats() const {
+    return {hits_.load(), misses_.load(), coalesced_.load(), evictions_.load()};
+}
+
+QueryCache::Shard& QueryCache::GetShard(const string& key) {
+    return shards_[hash<string>{}(key) % SHARD_COUNT];
+}
+
+bool QueryCache::Find(const string& key, uint64_t generation, optional<promise<vector<Document>>>& promise, Result& result) {
+    Shard& shard = GetShard(key);
+    lock_guard lock(shard.mutex);
+    const auto position = shard.positions.find(key);
+    if (position != shard.positions.end()) {
+        Entry& entry = *position->second;
+        if (entry.generation == generation) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+            result = entry.result;
+            if (result.wait_for(chrono::seconds(0)) == future_status::ready) {
+                ++hits_;
+            } else {
+                ++coalesced_;
+            }
+            return true;
+        }
+        ++misses_;
+        result = promise.emplace().get_future().share();
+        // читатель более старой копии индекса не должен затирать свежую запись
+        if (entry.generation < generation) {
+            entry.generation = generation;
+            entry.result = result;
+            shard.entries.splice(shard.entries.begin(), shard.entries, position->second);
+        }
+        return false;
+    }
+
+    ++misses_;
+    result = promise.emplace().get_future().share();
+    shard.entries.push_front({key, generation, result});
+    shard.positions.emplace(shard.entries.front().key, shard.entries.begin());
+    while (shard.entries.size() > shard_capacity_.load()) {
+        shard.positions.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+        ++evictions_;
+    }
+    return false;
+}
+
+void QueryCache::Erase(const string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    lock_guard lock(shard.mutex);
+    const auto position = shard.positions.find(key);
+    if (position != shard.positions.end() && position->second->generation == generation) {
+        const auto entry = position->second;
+        // ключ в positions ссылается на строку записи, поэтому запись удаляется последней
+        shard.positions.erase(position);
+        shard.entries.erase(entry);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "document.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Потокобезопасный кэш результатов запросов ограниченного размера; вытесняются давно не использованные записи.
+// Запись годна, пока не изменилось поколение индекса, для которого она посчитана. Одновременные промахи
+// по одному ключу выполняют один расчёт, остальные потоки дожидаются его результата
+class QueryCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        // промахи, дождавшиеся расчёта, начатого другим потоком
+        uint64_t coalesced = 0;
+        uint64_t evictions = 0;
+
+        double GetHitRate() const;
+    };
+
+    // capacity = 0 отключает кэш
+    explicit QueryCache(size_t capacity = 0);
+
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // Сбрасывает все записи
+    void SetCapacity(size_t capacity);
+
+    bool IsEnabled() const;
+
+    // Возвращает результат для key, посчитанный на поколении generation, либо вызывает compute
+    template <typename Compute>
+    std::vector<Document> GetOrCompute(const std::string& key, uint64_t generation, Compute compute);
+
+    Stats GetStats() const;
+
+private:
+    static const size_t SHARD_COUNT = 16;
+
+    using Result = std::shared_future<std::vector<Document>>;
+
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        Result result;
+    };
+
+    // Ключи распределены по независимым частям, чтобы потоки реже ждали один мьютекс
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        // в начале - последние использованные записи
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> positions;
+    };
+
+    std::atomic<size_t> shard_capacity_{0};
+    Shard shards_[SHARD_COUNT];
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> evictions_{0};
+
+    Shard& GetShard(const std::string& key);
+
+    // Возвращает true и результат из кэша (возможно, ещё считающийся) либо создаёт promise и заводит запись,
+    // которую заполнит вызывающий
+    bool Find(const std::string& key, uint64_t generation, std::optional<std::promise<std::vector<Document>>>& promise, Result& result);
+
+    // Удаляет незаполненную запись, если расчёт завершился исключением
+    void Erase(const std::string& key, uint64_t generation);
+};
+
+
+template <typename Compute>
+std::vector<Document> QueryCache::GetOrCompute(const std::string& key, uint64_t generation, Compute compute) {
+    // promise выделяет общее состояние, поэтому создаётся только при промахе
+    std::optional<std::promise<std::vector<Document>>> promise;
+    Result result;
+    if (Find(key, generation, promise, result)) {
+        return result.get();
+    }
+    try {
+        promise->set_value(compute());
+    } catch (...) {
+        promise->set_exception(std::current_exception());
+        Erase(key, generation);
+        throw;
+    }
+    return result.get();
+}
@@ -0,0 +1,16 @@
+#include "relevance_accumulator.h"
+
+using namespace std;
+
+void RelevanceAccumulator::Reset(size_t document_count) {
+    for (const uint32_t ordinal : touched_) {
+        relevances_[ordinal] = 0.0;
+        states_[ordinal] = State::UNTOUCHED;
+    }
+    touched_.clear();
+    document_count_ = document_count;
+    if (relevances_.size() < document_count) {
+        relevances_.resize(document_count, 0.0);
+        states_.resize(document_count, State::UNTOUCHED);
+    }
+}
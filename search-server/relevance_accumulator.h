@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Плоский буфер релевантностей, индексируемый внутренним номером документа.
+// Рассчитан на повторное использование: Reset очищает только затронутые ячейки
+class RelevanceAccumulator {
+public:
+    void Reset(size_t document_count);
+
+    void Add(uint32_t ordinal, double relevance) {
+        auto& state = states_[ordinal];
+        if (state == State::UNTOUCHED) {
+            state = State::SCORED;
+            touched_.push_back(ordinal);
+        }
+        if (state == State::SCORED) {
+            relevances_[ordinal] += relevance;
+        }
+    }
+
+    // Добавляет релевантность только документу, уже получившему её через Add
+    void AddIfScored(uint32_t ordinal, double relevance) {
+        if (states_[ordinal] == State::SCORED) {
+            relevances_[ordinal] += relevance;
+        }
+    }
+
+    // Документ с минус-словом не попадёт в выдачу независимо от порядка вызовов Add и Exclude
+    void Exclude(uint32_t ordinal) {
+        auto& state = states_[ordinal];
+        if (state == State::UNTOUCHED) {
+            touched_.push_back(ordinal);
+        }
+        state = State::EXCLUDED;
+    }
+
+    bool IsExcluded(uint32_t ordinal) const {
+        return states_[ordinal] == State::EXCLUDED;
+    }
+
+    size_t GetTouchedCount() const {
+        return touched_.size();
+    }
+
+    // Обходит документы в порядке первого обращения
+    template <typename Callback>
+    void ForEachScored(Callback callback) const {
+        for (const uint32_t ordinal : touched_) {
+            if (states_[ordinal] == State::SCORED) {
+                callback(ordinal, relevances_[ordinal]);
+            }
+        }
+    }
+
+    // Обходит документы по возрастанию номеров: редкие затронутые номера сортируются,
+    // при плотном заполнении дешевле просмотреть состояния подряд
+    template <typename Callback>
+    void ForEachScoredInOrder(Callback callback) {
+        if (touched_.size() * SPARSE_TOUCHED_SHARE < document_count_) {
+            std::sort(touched_.begin(), touched_.end());
+            for (const uint32_t ordinal : touched_) {
+                if (states_[ordinal] == State::SCORED) {
+                    callback(ordinal, relevances_[ordinal]);
+                }
+            }
+            return;
+        }
+        for (uint32_t ordinal = 0; ordinal < document_count_; ++ordinal) {
+            if (states_[ordinal] == State::SCORED) {
+                callback(ordinal, relevances_[ordinal]);
+            }
+        }
+    }
+
+private:
+    static const size_t SPARSE_TOUCHED_SHARE = 8;
+
+    enum class State : uint8_t {
+        UNTOUCHED,
+        SCORED,
+        EXCLUDED,
+    };
+
+    std::vector<double> relevances_;
+    std::vector<State> states_;
+    std::vector<uint32_t> touched_;
+    size_t document_count_ = 0;
+};
@@ -0,0 +1,14 @@
+#include "remove_duplicates.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+void RemoveDuplicates(SearchServer& search_server) {
+    const vector<int> duplicates = search_server.FindDuplicates();
+    for (const int document_id : duplicates) {
+        cout << "Found duplicate document id "s << document_id << endl;
+    }
+    search_server.RemoveDocuments(duplicates);
+}
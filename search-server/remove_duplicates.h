@@ -0,0 +1,7 @@
+#pragma once
+
+#include "search_server.h"
+
+// Удаляет документы с тем же набором слов, что у документа с меньшим идентификатором,
+// одним вызовом RemoveDocuments и сообщает о каждом удалённом
+void RemoveDuplicates(SearchServer& search_server);
@@ -1,36 +1,193 @@
 #include "request_queue.h"
 
+#include <algorithm>
+
 using namespace std;
 
+namespace {
+
+atomic<uint64_t> next_queue_id{0};
+
+} // namespace
+
+RequestQueue::RequestQueue(const SearchServer& search_server, Clock::duration window)
+    : search_server_(search_server)
+    , start_time_(Clock::now())
+    , bucket_duration_(max<Clock::duration>(window / WINDOW_BUCKET_COUNT, Clock::duration(1)))
+    , id_(next_queue_id.fetch_add(1)) {
+}
+
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
-    const auto result = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(result.size());
+    const Clock::time_point start_time = Clock::now();
+    auto result = search_server_.FindTopDocuments(raw_query, status);
+    AddRequest(result.size(), start_time);
     return result;
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query) { 
-    const auto result = search_server_.FindTopDocuments(raw_query);
-    AddRequest(result.size());
+    const Clock::time_point start_time = Clock::now();
+    auto result = search_server_.FindTopDocuments(raw_query);
+    AddRequest(result.size(), start_time);
     return result;
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return no_results_requests_;
+    Stats stats;
+    CollectStats(GetSlot(Clock::now()), stats);
+    return stats.no_result_count;
 }
 
-void RequestQueue::AddRequest(int results_num) {
-    ++current_time_;
-    while(!requests_.empty() && current_time_ - requests_.front().timestamp >= min_in_day_) {
-        if (requests_.front().results == 0) {
-            --no_results_requests_;
+RequestQueue::Stats RequestQueue::GetStats() const {
+    const Clock::time_point now = Clock::now();
+    const uint64_t current_slot = GetSlot(now);
+    Stats stats;
+    CollectStats(current_slot, stats);
+
+    // окно ещё не набралось целиком в первые интервалы после создания очереди
+    const uint64_t first_slot = current_slot + 1 >= WINDOW_BUCKET_COUNT ? current_slot + 1 - WINDOW_BUCKET_COUNT : 0;
+    const chrono::duration<double> covered = now - (start_time_ + bucket_duration_ * first_slot);
+    if (covered.count() > 0) {
+        stats.queries_per_second = stats.request_count / covered.count();
+    }
+    if (stats.request_count > 0) {
+        stats.no_result_rate = stats.no_result_count * 1.0 / stats.request_count;
+    }
+    stats.latency_p50 = stats.latencies.GetQuantile(0.5);
+    stats.latency_p95 = stats.latencies.GetQuantile(0.95);
+    stats.latency_p99 = stats.latencies.GetQuantile(0.99);
+    stats.latency_p999 = stats.latencies.GetQuantile(0.999);
+    return stats;
+}
+
+struct RequestQueue::ThreadRegistrations {
+    struct Registration {
+        uint64_t queue_id;
+        weak_ptr<SharedState> state;
+        ThreadStats* stats;
+    };
+
+    vector<Registration> registrations;
+
+    ~ThreadRegistrations() {
+        for (const Registration& registration : registrations) {
+            if (const auto state = registration.state.lock()) {
+                lock_guard lock(state->mutex);
+                registration.stats->is_free = true;
+            }
         }
-        requests_.pop_front();
     }
-        
-    requests_.push_back({current_time_, results_num});
-    if (results_num == 0) {
-        ++no_results_requests_;
+};
+
+RequestQueue::ThreadStats& RequestQueue::GetThreadStats() {
+    // обычно поток обращается к одной очереди, и поиск в списке очередей потока идёт один раз
+    thread_local ThreadRegistrations thread_registrations;
+    thread_local uint64_t cached_queue_id = NO_SLOT;
+    thread_local ThreadStats* cached_stats = nullptr;
+    if (cached_queue_id == id_) {
+        return *cached_stats;
+    }
+    auto& registrations = thread_registrations.registrations;
+    auto it = find_if(registrations.begin(), registrations.end(), [this](const auto& registration) {
+        return registration.queue_id == id_;
+    });
+    if (it == registrations.end()) {
+        registrations.erase(remove_if(registrations.begin(), registrations.end(), [](const auto& registration) {
+            return registration.state.expired();
+        }), registrations.end());
+        ThreadStats* stats = nullptr;
+        {
+            // счётчики завершившегося потока продолжает новый поток, поэтому уже набранное за окно не теряется
+            lock_guard lock(state_->mutex);
+            for (const auto& thread_stats : state_->thread_stats) {
+                if (thread_stats->is_free) {
+                    stats = thread_stats.get();
+                    stats->is_free = false;
+                    break;
+                }
+            }
+            if (stats == nullptr) {
+                stats = state_->thread_stats.emplace_back(make_unique<ThreadStats>()).get();
+            }
+        }
+        it = registrations.insert(registrations.end(), {id_, state_, stats});
     }
+    cached_queue_id = id_;
+    cached_stats = it->stats;
+    return *cached_stats;
 }
 
+void RequestQueue::StartSlot(ThreadStats& stats, uint64_t slot) {
+    const uint64_t previous_slot = stats.slot.load(memory_order_relaxed);
+    if (previous_slot != NO_SLOT) {
+        WindowBucket& bucket = state_->buckets[previous_slot % WINDOW_BUCKET_COUNT];
+        if (bucket.slot == NO_SLOT || bucket.slot < previous_slot) {
+            bucket = WindowBucket{};
+            bucket.slot = previous_slot;
+        }
+        // общая часть могла уже уйти вперёд: тогда прежняя часть потока вне окна и отбрасывается
+        if (bucket.slot == previous_slot) {
+            bucket.request_count += stats.request_count.load(memory_order_relaxed);
+            bucket.no_result_count += stats.no_result_count.load(memory_order_relaxed);
+            for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+                if (const uint32_t count = stats.latency_counts[i].load(memory_order_relaxed); count > 0) {
+                    bucket.latencies.Add(i, count);
+                }
+            }
+        }
+    }
+    stats.request_count.store(0, memory_order_relaxed);
+    stats.no_result_count.store(0, memory_order_relaxed);
+    for (auto& count : stats.latency_counts) {
+        count.store(0, memory_order_relaxed);
+    }
+    stats.slot.store(slot, memory_order_relaxed);
+}
+
+uint64_t RequestQueue::GetSlot(Clock::time_point time) const {
+    return (time - start_time_) / bucket_duration_;
+}
+
+void RequestQueue::AddRequest(size_t result_count, Clock::time_point start_time) {
+    const Clock::time_point finish_time = Clock::now();
+    const uint64_t slot = GetSlot(finish_time);
+    ThreadStats& stats = GetThreadStats();
+    // slot меняет только владелец, поэтому сравнить его можно без мьютекса
+    if (stats.slot.load(memory_order_relaxed) != slot) {
+        lock_guard lock(state_->mutex);
+        StartSlot(stats, slot);
+    }
+    const auto increment = [](atomic<uint32_t>& counter) {
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    };
+    increment(stats.request_count);
+    if (result_count == 0) {
+        increment(stats.no_result_count);
+    }
+    increment(stats.latency_counts[LatencyHistogram::GetBucket(finish_time - start_time)]);
+}
 
+void RequestQueue::CollectStats(uint64_t current_slot, Stats& stats) const {
+    const auto is_in_window = [current_slot](uint64_t slot) {
+        return slot != NO_SLOT && slot <= current_slot && current_slot - slot < WINDOW_BUCKET_COUNT;
+    };
+    lock_guard lock(state_->mutex);
+    for (const WindowBucket& bucket : state_->buckets) {
+        if (is_in_window(bucket.slot)) {
+            stats.request_count += bucket.request_count;
+            stats.no_result_count += bucket.no_result_count;
+            stats.latencies.Merge(bucket.latencies);
+        }
+    }
+    for (const auto& thread_stats : state_->thread_stats) {
+        if (!is_in_window(thread_stats->slot.load(memory_order_relaxed))) {
+            continue;
+        }
+        stats.request_count += thread_stats->request_count.load(memory_order_relaxed);
+        stats.no_result_count += thread_stats->no_result_count.load(memory_order_relaxed);
+        for (size_t i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+            if (const uint32_t count = thread_stats->latency_counts[i].load(memory_order_relaxed); count > 0) {
+                stats.latencies.Add(i, count);
+            }
+        }
+    }
+}
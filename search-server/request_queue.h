@@ -2,46 +2,115 @@
 
 #include "search_server.h"
 #include "document.h"
+#include "latency_histogram.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
-#include <deque>
 
+// Фронтенд запросов со статистикой за скользящее окно реального времени. Запросы можно выполнять
+// из нескольких потоков: каждый поток пишет только в счётчики текущей части окна без блокировок
+// и атомарных read-modify-write операций. Закончившуюся часть поток под мьютексом прибавляет к общим
+// частям окна, поэтому у потока одна часть, а не все. Счётчики завершившегося потока достаются
+// следующему новому потоку, и память не растёт с числом когда-либо обращавшихся потоков
 class RequestQueue {
 public:
-    explicit RequestQueue( const SearchServer& search_server) :search_server_(search_server), no_results_requests_(0), current_time_(0) {
-    }
+    using Clock = std::chrono::steady_clock;
+
+    // Окно делится на WINDOW_BUCKET_COUNT частей и сдвигается по одной части, поэтому статистика
+    // охватывает от (WINDOW_BUCKET_COUNT - 1) / WINDOW_BUCKET_COUNT окна до целого окна
+    explicit RequestQueue(const SearchServer& search_server, Clock::duration window = std::chrono::hours(24));
+
+    RequestQueue(const RequestQueue&) = delete;
+    RequestQueue& operator=(const RequestQueue&) = delete;
 
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) ;
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
     
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
      
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
+    // Запросы без результатов за окно
     int GetNoResultRequests() const;
+
+    struct Stats {
+        uint64_t request_count = 0;
+        uint64_t no_result_count = 0;
+        double queries_per_second = 0.0;
+        double no_result_rate = 0.0;
+        std::chrono::nanoseconds latency_p50{0};
+        std::chrono::nanoseconds latency_p95{0};
+        std::chrono::nanoseconds latency_p99{0};
+        std::chrono::nanoseconds latency_p999{0};
+        LatencyHistogram latencies;
+    };
+
+    Stats GetStats() const;
     
 private:
-    struct QueryResult {
-        uint64_t timestamp;
-        int results;
+    static constexpr size_t WINDOW_BUCKET_COUNT = 32;
+    static const uint64_t NO_SLOT = std::numeric_limits<uint64_t>::max();
+
+    // Текущая часть окна потока. Счётчики увеличивает только поток-владелец обычными load и store,
+    // а slot и сброс счётчиков меняются под мьютексом, поэтому читатель под мьютексом видит целую часть
+    struct ThreadStats {
+        // номер интервала времени, к которому относятся счётчики
+        std::atomic<uint64_t> slot{NO_SLOT};
+        std::atomic<uint32_t> request_count{0};
+        std::atomic<uint32_t> no_result_count{0};
+        std::atomic<uint32_t> latency_counts[LatencyHistogram::BUCKET_COUNT]{};
+        // поток-владелец завершился; защищено мьютексом
+        bool is_free = false;
     };
-    std::deque<QueryResult> requests_;
+
+    // Закончившиеся части окна всех потоков
+    struct WindowBucket {
+        uint64_t slot = NO_SLOT;
+        uint64_t request_count = 0;
+        uint64_t no_result_count = 0;
+        LatencyHistogram latencies;
+    };
+
+    // Потоки ссылаются на состояние слабо: очередь может быть разрушена раньше потока
+    struct SharedState {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadStats>> thread_stats;
+        WindowBucket buckets[WINDOW_BUCKET_COUNT];
+    };
+
+    // Счётчики потока во всех очередях, к которым он обращался; освобождаются при завершении потока
+    struct ThreadRegistrations;
+
     const SearchServer& search_server_;
-    int no_results_requests_;
-    uint64_t current_time_;
-    const static int min_in_day_ = 1440;
-    
-    void AddRequest(int results_num);
-        
+    const Clock::time_point start_time_;
+    const Clock::duration bucket_duration_;
+    // отличает очередь от созданной позже по тому же адресу в кэше потока
+    const uint64_t id_;
+    const std::shared_ptr<SharedState> state_ = std::make_shared<SharedState>();
+
+    ThreadStats& GetThreadStats();
+
+    // Переносит счётчики потока в общую часть окна и начинает часть slot; вызывается под мьютексом
+    void StartSlot(ThreadStats& stats, uint64_t slot);
+
+    uint64_t GetSlot(Clock::time_point time) const;
+
+    void AddRequest(size_t result_count, Clock::time_point start_time);
+
+    // Складывает в stats счётчики частей, попадающих в окно, заканчивающееся интервалом current_slot
+    void CollectStats(uint64_t current_slot, Stats& stats) const;
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    AddRequest(result.size());
+    const Clock::time_point start_time = Clock::now();
+    auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
+    AddRequest(result.size(), start_time);
     return result;
 }
-
-
-
-
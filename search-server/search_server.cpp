@@ -1,14 +1,33 @@
 #include "search_server.h"
 
+#include <cstdio>
+
 using namespace std;
 
+namespace {
+
+// Часть пакета документов, которую разбирает один поток; слова нумеруются локально
+struct BatchChunk {
+    size_t first_document = 0;
+    size_t last_document = 0;
+    unordered_map<string_view, uint32_t> local_ids;
+    vector<string_view> words;
+    vector<TermId> term_ids;
+    vector<vector<uint32_t>> document_words;
+    exception_ptr error;
+};
+
+} // namespace
+
+const uint32_t SearchServer::PRUNING_WINDOW_SIZE;
+
  SearchServer::SearchServer(string_view stop_words_text) {
-    for (string_view word: SplitIntoWords(stop_words_text)) {
-        if (!IsValidWord(word)) {
+    ForEachWord(stop_words_text, [this](string_view word, bool is_valid) {
+        if (!is_valid) {
              throw invalid_argument("Some of stop words are invalid");
         }
-        stop_words_.insert(string(word));
-    }
+        stop_words_.emplace(word);
+    });
 }
 
  SearchServer::SearchServer(const string& stop_words_text) : SearchServer(string_view(stop_words_text)) {
@@ -16,31 +35,206 @@ using namespace std;
 } 
                          
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-        if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    ApplyAddDocument(document_id, document, status, ratings, 0);
+}
+
+void SearchServer::ApplyAddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings, uint64_t replayed_sequence_number) {
+        TRACE_OPERATION(ADD_DOCUMENT);
+        lock_guard lock(write_mutex_);
+        const Index& published_index = GetPublishedIndex();
+        if ((document_id < 0) || (published_index.document_ids.Find(document_id) != NO_ORDINAL)) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        // слова сначала только собираются: недопустимое слово не должно оставить следов в индексе
+        static thread_local vector<string_view> words;
+        {
+            TRACE_STAGE(SPLIT_WORDS);
+            SplitIntoWordsNoStop(document, words);
+        }
+        TRACE_COUNT(DOCUMENT_WORDS, words.size());
+        uint64_t log_sequence_number = replayed_sequence_number != 0 ? replayed_sequence_number : published_index.log_sequence_number;
+        if (log_) {
+            TRACE_STAGE(WRITE_AHEAD_LOG);
+            log_sequence_number = log_->AppendAddDocument(document_id, document, status, ratings);
+        }
+    
+        const int rating = ComputeAverageRating(ratings);
+        TRACE_STAGE(INDEX_UPDATE);
+        const shared_ptr<PostingSegment> merged_segment = TakeMergedSegment();
+        ModifyIndex([&](Index& index) {
+            ApplySegmentMerge(index, merged_segment);
+            AddDocumentToIndex(index, document_id, words, status, rating);
+            index.log_sequence_number = log_sequence_number;
+        });
+        ScheduleSegmentMerge();
+}
+
+void SearchServer::AddDocumentToIndex(Index& index, int document_id, const vector<string_view>& words, DocumentStatus status, int rating) {
+    const double inv_word_count = 1.0 / words.size();
+    const uint32_t ordinal = index.documents.size();
+    unordered_map<TermId, double> term_freqs;
+    for (const string_view word : words) {
+        term_freqs[index.terms.Add(word)] += inv_word_count;
+    }
+    index.word_to_document_freqs.AddDocument(ordinal, term_freqs);
+    index.forward_index.AddDocument(term_freqs);
+    index.documents.push_back({document_id, rating, status});
+    index.attributes.AddDocument(status, rating);
+    index.document_ids.Insert(document_id, ordinal);
+}
+
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    ApplyAddDocuments(documents, 0);
+}
+
+void SearchServer::ApplyAddDocuments(const vector<NewDocument>& documents, uint64_t replayed_sequence_number) {
+    TRACE_OPERATION(ADD_DOCUMENTS);
+    lock_guard lock(write_mutex_);
+    const Index& published_index = GetPublishedIndex();
+    unordered_set<int> batch_ids;
+    for (const NewDocument& document : documents) {
+        if ((document.id < 0) || (published_index.document_ids.Find(document.id) != NO_ORDINAL) || !batch_ids.insert(document.id).second) {
             throw invalid_argument("Invalid document_id"s);
         }
-        const auto words = SplitIntoWordsNoStop(document);
+    }
+    
+    const size_t chunk_count = max<size_t>(1, min<size_t>(documents.size(), (thread_pool_->GetWorkerCount() + 1) * PARALLEL_PARTS_PER_THREAD));
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / max<size_t>(1, chunk_count);
+    vector<BatchChunk> chunks(chunk_count);
+    for (size_t i = 0; i < chunk_count; ++i) {
+        chunks[i].first_document = min(i * chunk_size, documents.size());
+        chunks[i].last_document = min(chunks[i].first_document + chunk_size, documents.size());
+    }
     
-        const double inv_word_count = 1.0 / words.size();
-        for (const string& word : words) {
-            all_words.insert(word);
-   
-            auto it = all_words.find(word);
-            string_view sv(*it);
+    {
+        TRACE_STAGE(SPLIT_WORDS);
+        // ошибки сохраняются по частям, чтобы сообщить об ошибке первого по порядку документа
+        ForEachIndex(SelectThreadPool(execution::par), chunks.size(), [this, &documents, &chunks](size_t chunk_index) {
+            BatchChunk& chunk = chunks[chunk_index];
+            try {
+                vector<string_view> words;
+                chunk.document_words.reserve(chunk.last_document - chunk.first_document);
+                for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+                    SplitIntoWordsNoStop(documents[i].text, words);
+                    auto& document_words = chunk.document_words.emplace_back();
+                    document_words.reserve(words.size());
+                    for (const string_view word : words) {
+                        const auto [it, inserted] = chunk.local_ids.emplace(word, chunk.words.size());
+                        if (inserted) {
+                            chunk.words.push_back(word);
+                        }
+                        document_words.push_back(it->second);
+                    }
+                }
+            } catch (...) {
+                chunk.error = current_exception();
+            }
+        });
+        for (const BatchChunk& chunk : chunks) {
+            if (chunk.error) {
+                rethrow_exception(chunk.error);
+            }
+        }
+    }
+    uint64_t log_sequence_number = replayed_sequence_number != 0 ? replayed_sequence_number : published_index.log_sequence_number;
+    if (log_) {
+        TRACE_STAGE(WRITE_AHEAD_LOG);
+        log_sequence_number = log_->AppendAddDocuments(documents);
+    }
     
-            word_to_document_freqs_[sv][document_id] += inv_word_count;
-            id_to_word_freqs_[document_id][sv] += inv_word_count;
-            
+    // обе копии нумеруют слова одинаково, поэтому частоты считаются один раз
+    vector<unordered_map<TermId, double>> term_freqs;
+    TRACE_STAGE(INDEX_UPDATE);
+    const shared_ptr<PostingSegment> merged_segment = TakeMergedSegment();
+    ModifyIndex([&](Index& index) {
+        ApplySegmentMerge(index, merged_segment);
+        // словарь общий, поэтому слова частей добавляются в него последовательно, каждое по одному разу на часть
+        for (BatchChunk& chunk : chunks) {
+            chunk.term_ids.clear();
+            chunk.term_ids.reserve(chunk.words.size());
+            for (const string_view word : chunk.words) {
+                chunk.term_ids.push_back(index.terms.Add(word));
+            }
+        }
+        
+        if (term_freqs.size() != documents.size()) {
+            term_freqs.resize(documents.size());
+            ForEachIndex(SelectThreadPool(execution::par), chunks.size(), [&term_freqs, &chunks](size_t chunk_index) {
+                const BatchChunk& chunk = chunks[chunk_index];
+                for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+                    const auto& document_words = chunk.document_words[i - chunk.first_document];
+                    const double inv_word_count = 1.0 / document_words.size();
+                    for (const uint32_t local_id : document_words) {
+                        term_freqs[i][chunk.term_ids[local_id]] += inv_word_count;
+                    }
+                }
+            });
+        }
+        
+        for (size_t i = 0; i < documents.size(); ++i) {
+            const uint32_t ordinal = index.documents.size();
+            index.word_to_document_freqs.AddDocument(ordinal, term_freqs[i]);
+            index.forward_index.AddDocument(term_freqs[i]);
+            const int rating = ComputeAverageRating(documents[i].ratings);
+            index.documents.push_back({documents[i].id, rating, documents[i].status});
+            index.attributes.AddDocument(documents[i].status, rating);
+            index.document_ids.Insert(documents[i].id, ordinal);
+        }
+        index.log_sequence_number = log_sequence_number;
+    });
+    ScheduleSegmentMerge();
+}
+
+void SearchServer::ScheduleSegmentMerge() {
+    if (is_merging_segments_) {
+        return;
+    }
+    // прежний план отпускается под блокировкой: уплотнение должно видеть, что его сегменты больше не общие
+    segment_merge_ = GetPublishedIndex().word_to_document_freqs.PlanMerge();
+    if (segment_merge_.buffers.empty() && segment_merge_.segments.empty()) {
+        return;
+    }
+    is_merging_segments_ = true;
+    thread_pool_->Submit([this, merge = segment_merge_] {
+        shared_ptr<PostingSegment> merged_segment = PostingIndex::BuildMerge(merge);
+        {
+            lock_guard lock(merged_segment_mutex_);
+            merged_segment_ = move(merged_segment);
+        }
+        // писатель, который держит блокировку, сам поставит сегмент своим изменением индекса:
+        // ожидание блокировки здесь могло бы длиться, пока добавления идут одно за другим
+        unique_lock lock(write_mutex_, try_to_lock);
+        if (!lock.owns_lock()) {
+            return;
+        }
+        merged_segment = TakeMergedSegment();
+        if (merged_segment) {
+            ModifyIndex([this, &merged_segment](Index& index) {
+                ApplySegmentMerge(index, merged_segment);
+            });
+            ScheduleSegmentMerge();
         }
-        documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
-        document_ids_.insert(document_id);
+    });
+}
+
+shared_ptr<PostingSegment> SearchServer::TakeMergedSegment() {
+    lock_guard lock(merged_segment_mutex_);
+    if (merged_segment_) {
+        is_merging_segments_ = false;
+    }
+    return move(merged_segment_);
+}
+
+void SearchServer::ApplySegmentMerge(Index& index, const shared_ptr<PostingSegment>& merged_segment) const {
+    if (merged_segment) {
+        index.word_to_document_freqs.ApplyMerge(segment_merge_, merged_segment);
+    }
 }
 
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
-        return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+        return FindTopDocuments(execution::seq, raw_query, status);
 }
 
 
@@ -48,131 +242,413 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
         return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const DocumentFilter& filter) const {
+    return FindTopDocuments(execution::seq, raw_query, filter);
+}
+
+
+BatchResults SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status) const {
+    TRACE_OPERATION(FIND_TOP_DOCUMENTS_BATCH);
+    struct BatchWord {
+        string_view data;
+        uint32_t query;
+        bool is_minus;
+    };
+    
+    const IndexGuard index(*this);
+    vector<Query> queries(raw_queries.size());
+    {
+        TRACE_STAGE(PARSE_QUERY);
+        vector<BatchWord> words;
+        for (uint32_t query = 0; query < raw_queries.size(); ++query) {
+            ForEachWord(raw_queries[query], [&words, query](string_view word, bool is_valid) {
+                const auto query_word = ParseQueryWordSyntax(word, is_valid);
+                words.push_back({query_word.data, query, query_word.is_minus});
+            });
+        }
+    
+        // одинаковые слова разных запросов оказываются рядом, и стоп-слова и словарь проверяются один раз на слово
+        sort(words.begin(), words.end(), [](const BatchWord& lhs, const BatchWord& rhs) {
+            return lhs.data < rhs.data;
+        });
+        TermId term = TermDictionary::NO_TERM;
+        for (size_t i = 0; i < words.size(); ++i) {
+            if (i == 0 || words[i].data != words[i - 1].data) {
+                term = IsStopWord(words[i].data) ? TermDictionary::NO_TERM : index->terms.Find(words[i].data);
+            }
+            if (term == TermDictionary::NO_TERM) {
+                continue;
+            }
+            Query& query = queries[words[i].query];
+            if (words[i].is_minus) {
+                query.minus_terms.push_back(term);
+            } else {
+                query.plus_terms.push_back(term);
+            }
+        }
+    
+    }
+    
+    // Запросы делятся на части по BATCH_PART_QUERY_COUNT; найденные документы части дописываются в её буфер,
+    // затем буферы склеиваются. Место под max_count документов на каждый запрос заранее не выделяется:
+    // при большом max_count это были бы гигабайты, хотя запросы обычно находят немного документов
+    const size_t max_count = max_result_document_count_.load();
+    const size_t part_count = (raw_queries.size() + BATCH_PART_QUERY_COUNT - 1) / BATCH_PART_QUERY_COUNT;
+    vector<vector<Document>> part_documents(part_count);
+    vector<size_t> offsets(raw_queries.size() + 1, 0);
+    ForEachIndex(SelectThreadPool(execution::par), part_count, [&](size_t part) {
+        static thread_local TopDocuments top_documents(0);
+        vector<Document>& documents = part_documents[part];
+        const size_t last_query = min(raw_queries.size(), (part + 1) * BATCH_PART_QUERY_COUNT);
+        for (size_t query_index = part * BATCH_PART_QUERY_COUNT; query_index < last_query; ++query_index) {
+            Query& query = queries[query_index];
+            for (QueryTerms* terms : {&query.plus_terms, &query.minus_terms}) {
+                sort(terms->begin(), terms->end());
+                terms->resize(unique(terms->begin(), terms->end()) - terms->begin());
+            }
+            top_documents.Reset(max_count);
+            FindDocumentsInRange(*index, query, ScoreTerms(*index, query), 0, index->documents.size(),
+                                 DocumentFilter{status}, NO_DEADLINE, top_documents);
+            const size_t first = documents.size();
+            documents.resize(first + top_documents.GetSize());
+            offsets[query_index + 1] = top_documents.Extract(documents.data() + first);
+        }
+    });
+    
+    for (size_t query_index = 0; query_index < raw_queries.size(); ++query_index) {
+        offsets[query_index + 1] += offsets[query_index];
+    }
+    vector<Document> documents;
+    documents.reserve(offsets.back());
+    for (const vector<Document>& part : part_documents) {
+        documents.insert(documents.end(), part.begin(), part.end());
+    }
+    return {move(documents), move(offsets)};
+}
 
 int SearchServer::GetDocumentCount() const {
-        return documents_.size();
+        const IndexGuard index(*this);
+        return index->document_ids.size();
+}
+
+void SearchServer::SetMaxResultDocumentCount(size_t max_count) {
+    max_result_document_count_ = max_count;
+}
+
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+    query_cache_.SetCapacity(capacity);
+}
+
+QueryCache::Stats SearchServer::GetQueryCacheStats() const {
+    return query_cache_.GetStats();
+}
+
+future<FindResult> SearchServer::SubmitFind(string raw_query, DocumentStatus status, Deadline deadline) const {
+    auto result_promise = make_shared<promise<FindResult>>();
+    future<FindResult> result = result_promise->get_future();
+    if (!admission_queue_.Acquire(deadline)) {
+        result_promise->set_value({{}, true});
+        return result;
+    }
+    thread_pool_->Submit([this, raw_query = move(raw_query), status, deadline, result_promise] {
+        // место освобождается до публикации результата, чтобы получивший его мог сразу отправить следующий запрос
+        try {
+            FindResult find_result = FindTopDocumentsUntil(raw_query, status, deadline);
+            admission_queue_.Release();
+            result_promise->set_value(move(find_result));
+        } catch (...) {
+            admission_queue_.Release();
+            result_promise->set_exception(current_exception());
+        }
+    });
+    return result;
+}
+
+FindResult SearchServer::FindTopDocumentsUntil(string_view raw_query, DocumentStatus status, Deadline deadline) const {
+    TRACE_OPERATION(FIND_TOP_DOCUMENTS);
+    FindResult result;
+    // запрос мог простоять в очереди пула дольше своего срока: тогда он не разбирается вовсе
+    if (IsExpired(deadline)) {
+        result.is_truncated = true;
+        return result;
+    }
+    const IndexGuard index(*this);
+    const auto query = ParseQuery(*index, raw_query);
+    TopDocuments top_documents = FindAllDocuments(SelectThreadPool(execution::par), *index, query, DocumentFilter{status},
+                                                  max_result_document_count_.load(), deadline, result.is_truncated);
+    TRACE_STAGE(RANKING);
+    result.documents = top_documents.Extract();
+    return result;
 }
 
+void SearchServer::SetMaxPendingQueries(size_t max_count) {
+    admission_queue_.SetCapacity(max_count);
+}
+
+size_t SearchServer::GetPendingQueryCount() const {
+    return admission_queue_.GetPendingCount();
+}
+
+uint64_t SearchServer::GetRejectedQueryCount() const {
+    return admission_queue_.GetRejectedCount();
+}
 
-set<int>::const_iterator SearchServer::begin() const {
-    return document_ids_.begin();
+void SearchServer::SetWorkerCount(size_t worker_count) {
+    // задача слияния сегментов ставит следующую в пул под write_mutex_
+    lock_guard lock(write_mutex_);
+    thread_pool_ = make_unique<ThreadPool>(worker_count);
 }
 
-set<int>::const_iterator SearchServer::end() const {
-    return document_ids_.end();
+ThreadPool& SearchServer::GetThreadPool() const {
+    return *thread_pool_;
 }
 
 
-const unordered_map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const unordered_map<string_view, double> empty_map;
-    if (document_ids_.count(document_id) == 0) {
-         return empty_map;
+DocumentIdIndex::Iterator SearchServer::begin() const {
+    return indexes_[published_index_.load()].document_ids.begin();
+}
+
+DocumentIdIndex::Iterator SearchServer::end() const {
+    return indexes_[published_index_.load()].document_ids.end();
+}
+
+
+unordered_map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    unordered_map<string_view, double> word_freqs;
+    const IndexGuard index(*this);
+    const uint32_t ordinal = index->document_ids.Find(document_id);
+    if (ordinal == NO_ORDINAL) {
+         return word_freqs;
     }
-    return id_to_word_freqs_.at(document_id);
+    for (const TermId term : index->forward_index.GetTerms(ordinal)) {
+        word_freqs.emplace(index->terms.GetWord(term), index->word_to_document_freqs.GetTermFreq(term, ordinal));
+    }
+    return word_freqs;
 }
 
 
 void SearchServer::RemoveDocument(int document_id) {
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
-    
-    for(const auto& [word, _]: id_to_word_freqs_[document_id]) {
-        word_to_document_freqs_[word].erase(document_id);
+    RemoveDocument(execution::seq, document_id);
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    ApplyRemoveDocuments(document_ids, 0);
+}
+
+void SearchServer::ApplyRemoveDocuments(const vector<int>& document_ids, uint64_t replayed_sequence_number) {
+    TRACE_OPERATION(REMOVE_DOCUMENTS);
+    lock_guard lock(write_mutex_);
+    const auto removed_documents = FindRemovedDocuments(document_ids);
+    if (removed_documents.empty()) {
+        return;
     }
-    
-    id_to_word_freqs_.erase(document_id);
+    vector<int> removed_ids;
+    removed_ids.reserve(removed_documents.size());
+    for (const RemovedDocument& document : removed_documents) {
+        removed_ids.push_back(document.id);
+    }
+    uint64_t log_sequence_number = replayed_sequence_number != 0 ? replayed_sequence_number : GetPublishedIndex().log_sequence_number;
+    if (log_) {
+        TRACE_STAGE(WRITE_AHEAD_LOG);
+        log_sequence_number = log_->AppendRemoveDocuments(removed_ids);
+    }
+    TRACE_STAGE(INDEX_UPDATE);
+    ModifyIndex([&](Index& index) {
+        RemoveDocumentsFromIndex(SelectThreadPool(execution::par), index, removed_documents);
+        index.log_sequence_number = log_sequence_number;
+    });
 }
 
+void SearchServer::CompactIndex() {
+    lock_guard lock(write_mutex_);
+    ModifyIndex([this](Index& index) {
+        index.word_to_document_freqs.Compact(SelectThreadPool(execution::par));
+    });
+}
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
-        if (document_ids_.count(document_id) == 0) {
-            throw out_of_range("out_of_range");
-        }
-        const auto query = ParseQuery(raw_query);
+void SearchServer::RemoveDocumentsFromIndex(ThreadPool* thread_pool, Index& index, const vector<RemovedDocument>& removed_documents) {
+    for (const RemovedDocument& document : removed_documents) {
+        index.document_ids.Erase(document.id);
+        index.word_to_document_freqs.RemoveDocument(document.ordinal, document.terms);
+        index.attributes.RemoveDocument(document.ordinal);
+        index.forward_index.ClearDocument(document.ordinal);
+    }
+    index.word_to_document_freqs.CompactIfNeeded(thread_pool);
+}
 
-        vector<string_view> matched_words;
-        matched_words.reserve(query.plus_words.size());
-        for (const string& word : query.plus_words) {
-            auto it = all_words.find(word);
-            if (it == all_words.end()) {
-                continue;
-            }
-            string_view sv(*it);
-            if (id_to_word_freqs_.at(document_id).count(sv)) {
-                matched_words.push_back(sv);
-            }
+vector<int> SearchServer::FindDuplicates() const {
+    const IndexGuard index(*this);
+    struct Entry {
+        uint64_t fingerprint;
+        int id;
+        uint32_t ordinal;
+    };
+    vector<vector<Entry>> parts(size_t{1} << DUPLICATE_PART_BITS);
+    for (uint32_t ordinal = 0; ordinal < index->documents.size(); ++ordinal) {
+        if (index->word_to_document_freqs.IsRemoved(ordinal)) {
+            continue;
         }
-        for (const string& word : query.minus_words) {
-            auto it = all_words.find(word);
-            if (it == all_words.end()) {
-                continue;
+        const uint64_t fingerprint = index->forward_index.GetFingerprint(ordinal);
+        parts[fingerprint >> (64 - DUPLICATE_PART_BITS)].push_back({fingerprint, index->documents[ordinal].id, ordinal});
+    }
+    vector<vector<int>> part_duplicates(parts.size());
+    ForEachIndex(SelectThreadPool(execution::par), parts.size(), [&](size_t part) {
+        vector<Entry>& entries = parts[part];
+        sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+            return tie(lhs.fingerprint, lhs.id) < tie(rhs.fingerprint, rhs.id);
+        });
+        // в группе с одним отпечатком остаются документы с разными наборами слов (коллизии хеша),
+        // каждый из них - первый по идентификатору со своим набором
+        vector<ArrayView<TermId>> originals;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i == 0 || entries[i].fingerprint != entries[i - 1].fingerprint) {
+                originals.clear();
             }
-            string_view sv(*it);
-            if (id_to_word_freqs_.at(document_id).count(sv)) {
-                matched_words.clear();
-                break;
+            const ArrayView<TermId> terms = index->forward_index.GetTerms(entries[i].ordinal);
+            const bool is_duplicate = any_of(originals.begin(), originals.end(), [&terms](ArrayView<TermId> original) {
+                return equal(original.begin(), original.end(), terms.begin(), terms.end());
+            });
+            if (is_duplicate) {
+                part_duplicates[part].push_back(entries[i].id);
+            } else {
+                originals.push_back(terms);
             }
         }
-        return {matched_words, documents_.at(document_id).status};
+    });
+    vector<int> duplicates;
+    for (const vector<int>& ids : part_duplicates) {
+        duplicates.insert(duplicates.end(), ids.begin(), ids.end());
+    }
+    sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+vector<SearchServer::RemovedDocument> SearchServer::FindRemovedDocuments(const vector<int>& document_ids) const {
+    const Index& published_index = GetPublishedIndex();
+    vector<RemovedDocument> removed_documents;
+    unordered_set<int> seen_ids;
+    for (const int document_id : document_ids) {
+        const uint32_t ordinal = published_index.document_ids.Find(document_id);
+        if (ordinal == NO_ORDINAL || !seen_ids.insert(document_id).second) {
+            continue;
+        }
+        auto& document = removed_documents.emplace_back();
+        document.id = document_id;
+        document.ordinal = ordinal;
+        const ArrayView<TermId> terms = published_index.forward_index.GetTerms(ordinal);
+        document.terms.assign(terms.begin(), terms.end());
+    }
+    return removed_documents;
+}
+
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    return MatchDocument(execution::seq, raw_query, document_id);
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution::sequenced_policy execution_type, string_view raw_query, int document_id) const {
-    return SearchServer::MatchDocument(raw_query, document_id);
+    TRACE_OPERATION(MATCH_DOCUMENT);
+    const IndexGuard index(*this);
+    const uint32_t ordinal = index->document_ids.Find(document_id);
+    if (ordinal == NO_ORDINAL) {
+        throw out_of_range("out_of_range");
+    }
+    return MatchTerms(nullptr, *index, ParseQuery(*index, raw_query), ordinal);
 }
 
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution::parallel_policy execution_type, string_view raw_query, int document_id) const {
-   
-    const auto query = ParseQuery(raw_query);
-  
-    vector<string_view> matched_words(query.plus_words.size());
-    
-    if (any_of(query.minus_words.begin(), query.minus_words.end(), [this, document_id] (const string& word) {
-        auto it = all_words.find(word);
-        if (it == all_words.end()) {
-            return false;
-        }
-        string_view sv(*it);
-        if (id_to_word_freqs_.at(document_id).count(sv)) {
-            return true;
-        }
-        return false;
-    }) ) {
-    
-        return {{}, documents_.at(document_id).status};
+    TRACE_OPERATION(MATCH_DOCUMENT);
+    const IndexGuard index(*this);
+    const uint32_t ordinal = index->document_ids.Find(document_id);
+    if (ordinal == NO_ORDINAL) {
+        throw out_of_range("out_of_range");
     }
-    
+    const auto query = ParseQuery(*index, raw_query);
+    // пересечение части слов дешевле передачи задачи в пул, поэтому короткие запросы проверяются в своём потоке
+    ThreadPool* thread_pool = query.plus_terms.size() + query.minus_terms.size() >= PARALLEL_MIN_MATCH_TERM_COUNT
+                              ? SelectThreadPool(execution_type) : nullptr;
+    return MatchTerms(thread_pool, *index, query, ordinal);
+}
 
-    transform(std::execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [this, document_id] (const string& word) {
-        auto it = all_words.find(word);
-        if (it == all_words.end()) {
-            return string_view{};
-        }
-        string_view sv(*it);
-        if (id_to_word_freqs_.at(document_id).count(sv)) {
-            return sv;
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(static_cast<ThreadPool*>(nullptr), raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(execution::sequenced_policy, string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(static_cast<ThreadPool*>(nullptr), raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(execution::parallel_policy execution_type, string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(SelectThreadPool(execution_type), raw_query, document_ids);
+}
+
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(ThreadPool* thread_pool, string_view raw_query, const vector<int>& document_ids) const {
+    TRACE_OPERATION(MATCH_DOCUMENTS);
+    const IndexGuard index(*this);
+    vector<uint32_t> ordinals(document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        ordinals[i] = index->document_ids.Find(document_ids[i]);
+        if (ordinals[i] == NO_ORDINAL) {
+            throw out_of_range("out_of_range");
         }
-        
-        return string_view{};
-    } ) ;
-    
-    
-    unordered_set<string_view> set_of_matched_words(matched_words.begin(), matched_words.end());
-    if (set_of_matched_words.count(string_view{})) {
-        set_of_matched_words.erase(string_view{});
-    }
-    matched_words.clear();
-    matched_words.resize(set_of_matched_words.size());
-    transform(set_of_matched_words.begin(), set_of_matched_words.end(), matched_words.begin(), [] (auto sv) {
-       return sv; 
+    }
+    const auto query = ParseQuery(*index, raw_query);
+
+    vector<tuple<vector<string_view>, DocumentStatus>> results(document_ids.size());
+    ForEachIndex(thread_pool, document_ids.size(), [&](size_t i) {
+        results[i] = MatchTerms(nullptr, *index, query, ordinals[i]);
     });
-    
-    return {matched_words, documents_.at(document_id).status};
+    return results;
+}
+
+void SearchServer::IntersectTerms(ThreadPool* thread_pool, const QueryTerms& query_terms, ArrayView<TermId> document_terms,
+                                  vector<TermId>& common_terms) {
+    common_terms.clear();
+    if (thread_pool == nullptr || query_terms.size() < PARALLEL_MIN_MATCH_TERM_COUNT) {
+        ForEachCommonValue({query_terms.begin(), query_terms.end()}, document_terms, [&common_terms](TermId term) {
+            common_terms.push_back(term);
+        });
+        return;
+    }
+    // каждая часть слов запроса пересекается только с тем участком документа, где могут быть её слова
+    const size_t part_count = (query_terms.size() + PARALLEL_MIN_MATCH_TERM_COUNT - 1) / PARALLEL_MIN_MATCH_TERM_COUNT;
+    vector<vector<TermId>> part_terms(part_count);
+    thread_pool->ParallelFor(part_count, [&](size_t part) {
+        const TermId* first = query_terms.begin() + part * PARALLEL_MIN_MATCH_TERM_COUNT;
+        const TermId* last = query_terms.begin() + min(query_terms.size(), (part + 1) * PARALLEL_MIN_MATCH_TERM_COUNT);
+        const TermId* document_first = lower_bound(document_terms.begin(), document_terms.end(), *first);
+        const TermId* document_last = upper_bound(document_first, document_terms.end(), *(last - 1));
+        ForEachCommonValue({first, last}, {document_first, document_last}, [&terms = part_terms[part]](TermId term) {
+            terms.push_back(term);
+        });
+    });
+    for (const auto& terms : part_terms) {
+        common_terms.insert(common_terms.end(), terms.begin(), terms.end());
+    }
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchTerms(ThreadPool* thread_pool, const Index& index, const Query& query, uint32_t ordinal) {
+    const DocumentStatus status = index.documents[ordinal].status;
+    const ArrayView<TermId> document_terms = index.forward_index.GetTerms(ordinal);
+    vector<TermId> common_terms;
+    IntersectTerms(thread_pool, query.minus_terms, document_terms, common_terms);
+    if (!common_terms.empty()) {
+        return {vector<string_view>{}, status};
+    }
+    IntersectTerms(thread_pool, query.plus_terms, document_terms, common_terms);
+    vector<string_view> matched_words;
+    matched_words.reserve(common_terms.size());
+    for (const TermId term : common_terms) {
+        matched_words.push_back(index.terms.GetWord(term));
+    }
+    sort(matched_words.begin(), matched_words.end());
+    return {matched_words, status};
 }
 
 
                         
-bool SearchServer::IsStopWord(const string& word) const {
+bool SearchServer::IsStopWord(string_view word) const {
     return stop_words_.count(word) > 0;
 }
 
@@ -184,18 +660,16 @@ bool SearchServer::IsValidWord(string_view word) {
 }
 
                         
-vector<string> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string> words;
-    for (string_view sv : SplitIntoWords(text)) {
-        string word(sv);
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + word + " is invalid"s);
+void SearchServer::SplitIntoWordsNoStop(string_view text, vector<string_view>& words) const {
+    words.clear();
+    ForEachWord(text, [this, &words](string_view word, bool is_valid) {
+        if (!is_valid) {
+            throw invalid_argument("Word "s + string(word) + " is invalid"s);
         }
         if (!IsStopWord(word)) {
             words.push_back(word);
         }
-    }
-    return words;
+    });
 }
 
                         
@@ -208,7 +682,13 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
 }
 
                         
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word, bool is_valid) const {
+    QueryWord query_word = ParseQueryWordSyntax(word, is_valid);
+    query_word.is_stop = IsStopWord(query_word.data);
+    return query_word;
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWordSyntax(string_view word, bool is_valid) {
     if (word.empty()) {
         throw invalid_argument("Query word is empty"s);
     }
@@ -219,35 +699,293 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
         word.remove_prefix(1);
     }
     
-    string res_word(word);
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
-        throw invalid_argument("Query word "s + res_word + " is invalid");
+    if (word.empty() || word[0] == '-' || !is_valid) {
+        throw invalid_argument("Query word "s + string(word) + " is invalid");
     }
     
-    return {res_word, is_minus, IsStopWord(res_word)};
+    return {word, is_minus, false};
 }
 
 
-SearchServer::Query SearchServer::ParseQuery(string_view text) const {
+SearchServer::Query SearchServer::ParseQuery(const Index& index, string_view text) const {
+    TRACE_STAGE(PARSE_QUERY);
+    Query query;
+    ForEachWord(text, [this, &index, &query](string_view word, bool is_valid) {
+        const auto query_word = ParseQueryWord(word, is_valid);
+        if (query_word.is_stop) {
+            return;
+        }
+        const TermId term = index.terms.Find(query_word.data);
+        if (term == TermDictionary::NO_TERM) {
+            return;
+        }
+        if (query_word.is_minus) {
+            query.minus_terms.push_back(term);
+        } else {
+            query.plus_terms.push_back(term);
+        }
+    });
     
-    set<string> set_of_minus_words, set_of_plus_words;
-    for (const string_view& word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                set_of_minus_words.insert(query_word.data);
-            } else {
-                set_of_plus_words.insert(query_word.data);
-            }
+    for (QueryTerms* terms : {&query.plus_terms, &query.minus_terms}) {
+        sort(terms->begin(), terms->end());
+        terms->resize(unique(terms->begin(), terms->end()) - terms->begin());
+    }
+    return query;
+}
+
+
+
+void SearchServer::SaveSnapshot(const string& path) const {
+    const IndexGuard index(*this);
+    // номера живых документов уплотняются, порядок сохраняется, поэтому списки постингов остаются отсортированными
+    vector<uint32_t> new_ordinals(index->documents.size(), NO_ORDINAL);
+    vector<DocumentData> documents;
+    documents.reserve(index->document_ids.size());
+    for (uint32_t ordinal = 0; ordinal < index->documents.size(); ++ordinal) {
+        if (index->document_ids.Find(index->documents[ordinal].id) == ordinal) {
+            new_ordinals[ordinal] = documents.size();
+            documents.push_back(index->documents[ordinal]);
+        }
+    }
+    
+    string stop_word_chars;
+    vector<uint64_t> stop_word_offsets{0};
+    for (const string& word : stop_words_) {
+        stop_word_chars += word;
+        stop_word_offsets.push_back(stop_word_chars.size());
+    }
+    
+    SnapshotWriter writer(path);
+    writer.WriteSection(SnapshotSection::STOP_WORD_CHARS, stop_word_chars.data(), stop_word_chars.size());
+    writer.WriteSection(SnapshotSection::STOP_WORD_OFFSETS, stop_word_offsets);
+    index->terms.Save(writer);
+    index->word_to_document_freqs.Save(writer, index->terms.GetTermCount(), new_ordinals);
+    writer.WriteSection(SnapshotSection::DOCUMENTS, documents);
+    DocumentAttributes attributes;
+    for (const DocumentData& document : documents) {
+        attributes.AddDocument(document.status, document.rating);
+    }
+    attributes.Save(writer);
+    index->document_ids.Save(writer, new_ordinals);
+    index->forward_index.Save(writer, new_ordinals);
+    writer.WriteSection(SnapshotSection::LOG_SEQUENCE_NUMBER, vector<uint64_t>{index->log_sequence_number});
+    writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const string& path, bool verify_checksums) {
+    const SnapshotReader reader(make_shared<MappedFile>(path), verify_checksums);
+    if (!verify_checksums) {
+        // обе копии отображают одни и те же байты файла, поэтому проверяется одна
+        ValidateSnapshot(reader);
+    }
+    // у каждой копии индекса своё отображение файла: удаление документа меняет страницы постингов
+    const SnapshotReader mirror_reader(reader.GetFile()->MapAgain(), false);
+    return SearchServer(reader, mirror_reader);
+}
+
+SearchServer::SearchServer(const SnapshotReader& reader, const SnapshotReader& mirror_reader) {
+    // стоп-слов мало, их проще скопировать
+    const auto [stop_word_chars, stop_word_chars_size] = reader.GetSection<char>(SnapshotSection::STOP_WORD_CHARS);
+    const auto [stop_word_offsets, stop_word_offset_count] = reader.GetSection<uint64_t>(SnapshotSection::STOP_WORD_OFFSETS);
+    if (stop_word_offset_count == 0 || stop_word_offsets[stop_word_offset_count - 1] > stop_word_chars_size) {
+        throw invalid_argument("Snapshot stop words are corrupted"s);
+    }
+    for (size_t i = 0; i + 1 < stop_word_offset_count; ++i) {
+        if (stop_word_offsets[i] > stop_word_offsets[i + 1]) {
+            throw invalid_argument("Snapshot stop words are corrupted"s);
+        }
+        stop_words_.emplace(stop_word_chars + stop_word_offsets[i], stop_word_offsets[i + 1] - stop_word_offsets[i]);
+    }
+    
+    LoadIndex(indexes_[0], reader);
+    LoadIndex(indexes_[1], mirror_reader);
+}
+
+void SearchServer::ValidateSnapshot(const SnapshotReader& reader) {
+    const auto [documents, document_count] = reader.GetSection<DocumentData>(SnapshotSection::DOCUMENTS);
+    for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        if (static_cast<size_t>(documents[ordinal].status) > static_cast<size_t>(DocumentStatus::REMOVED)) {
+            throw invalid_argument("Snapshot documents are corrupted"s);
+        }
+    }
+    DocumentAttributes::Validate(reader, document_count);
+    TermDictionary::Validate(reader);
+    const size_t term_count = reader.GetSection<uint64_t>(SnapshotSection::TERM_OFFSETS).second - 1;
+    PostingIndex::Validate(reader, document_count, term_count);
+    DocumentIdIndex::Validate(reader, document_count);
+    ForwardIndex::Validate(reader, document_count, term_count);
+}
+
+void SearchServer::LoadIndex(Index& index, const SnapshotReader& reader) {
+    index.terms.Load(reader);
+    index.word_to_document_freqs.Load(reader);
+    const auto [documents, document_count] = reader.GetSection<DocumentData>(SnapshotSection::DOCUMENTS);
+    index.documents.Attach(documents, document_count);
+    index.attributes.Load(reader, document_count);
+    index.document_ids.Load(reader);
+    index.forward_index.Load(reader);
+    const auto [log_sequence_number, log_sequence_number_count] = reader.GetSection<uint64_t>(SnapshotSection::LOG_SEQUENCE_NUMBER);
+    if (log_sequence_number_count != 1) {
+        throw invalid_argument("Snapshot log sequence number is corrupted"s);
+    }
+    index.log_sequence_number = *log_sequence_number;
+    index.snapshot_file = reader.GetFile();
+}
+
+void SearchServer::OpenWriteAheadLog(const string& path, size_t sync_record_count) {
+    if (log_) {
+        throw invalid_argument("Write-ahead log is already open"s);
+    }
+    LogReader reader(path);
+    LogRecord record;
+    uint64_t log_sequence_number = indexes_[published_index_.load()].log_sequence_number;
+    while (reader.Next(record)) {
+        // записи до контрольной точки уже есть в снимке
+        if (record.sequence_number <= log_sequence_number) {
+            continue;
+        }
+        // номер записи попадает в индекс тем же изменением, что и сама запись
+        if (record.type == LogRecordType::REMOVE_DOCUMENT) {
+            ApplyRemoveDocuments({record.document_id}, record.sequence_number);
+        } else if (record.type == LogRecordType::REMOVE_DOCUMENTS) {
+            ApplyRemoveDocuments(record.document_ids, record.sequence_number);
+        } else if (record.documents.size() == 1) {
+            const NewDocument& document = record.documents.front();
+            ApplyAddDocument(document.id, document.text, document.status, document.ratings, record.sequence_number);
+        } else {
+            ApplyAddDocuments(record.documents, record.sequence_number);
+        }
+        log_sequence_number = record.sequence_number;
+    }
+    lock_guard lock(write_mutex_);
+    log_ = make_unique<WriteAheadLog>(path, reader.GetValidSize(), log_sequence_number, sync_record_count);
+}
+
+void SearchServer::SyncWriteAheadLog() {
+    lock_guard lock(write_mutex_);
+    if (log_) {
+        log_->Sync();
+    }
+}
+
+void SearchServer::Checkpoint(const string& snapshot_path) {
+    // изменения ждут окончания контрольной точки, иначе они попали бы в журнал, но не в снимок
+    lock_guard lock(write_mutex_);
+    const string temporary_path = snapshot_path + ".tmp"s;
+    SaveSnapshot(temporary_path);
+    if (rename(temporary_path.c_str(), snapshot_path.c_str()) != 0) {
+        throw runtime_error("Cannot replace snapshot "s + snapshot_path);
+    }
+    if (log_) {
+        log_->Truncate();
+    }
+}
+
+RelevanceAccumulator& SearchServer::GetRelevanceAccumulator() {
+    static thread_local RelevanceAccumulator accumulator;
+    return accumulator;
+}
+
+SearchServer::ScoredTerms SearchServer::ScoreTerms(const Index& index, const Query& query) {
+    TRACE_STAGE(SCORE_TERMS);
+    ScoredTerms scored_terms;
+    // логарифмы частот слов хранятся в индексе, на запрос остаётся один логарифм
+    const double log_document_count = log(index.document_ids.size());
+    for (const TermId term : query.plus_terms) {
+        if (index.word_to_document_freqs.GetDocumentFreq(term) == 0) {
+            continue;
+        }
+        const double inverse_document_freq = log_document_count - index.word_to_document_freqs.GetLogDocumentFreq(term);
+        scored_terms.push_back({term, index.word_to_document_freqs.GetDocumentFreq(term), inverse_document_freq, index.word_to_document_freqs.GetMaxTermFreq(term) * inverse_document_freq});
+    }
+    sort(scored_terms.begin(), scored_terms.end(), [](const ScoredTerm& lhs, const ScoredTerm& rhs) {
+        return lhs.max_score != rhs.max_score ? lhs.max_score > rhs.max_score : lhs.term < rhs.term;
+    });
+    return scored_terms;
+}
+
+string SearchServer::MakeQueryCacheKey(const Query& query, const DocumentFilter& filter, size_t max_count) {
+    // слова запроса уже отсортированы и без повторов, поэтому ключ не зависит от их порядка в тексте
+    string key;
+    key.reserve(sizeof(uint32_t) * (query.plus_terms.size() + query.minus_terms.size() + 4) + sizeof(uint64_t));
+    const auto put = [&key](auto value) {
+        key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    // любой статус кодируется значением, которого нет среди статусов
+    put(filter.status ? static_cast<uint32_t>(*filter.status) : numeric_limits<uint32_t>::max());
+    put(filter.min_rating);
+    put(filter.max_rating);
+    put(static_cast<uint64_t>(max_count));
+    put(static_cast<uint32_t>(query.plus_terms.size()));
+    for (const TermId term : query.plus_terms) {
+        put(term);
+    }
+    for (const TermId term : query.minus_terms) {
+        put(term);
+    }
+    return key;
+}
+
+SearchServer::PruningStats SearchServer::GetPruningStats() const {
+    return {scanned_postings_.load(), skipped_postings_.load()};
+}
+
+SearchServer::MemoryStats SearchServer::GetMemoryStats() const {
+    MemoryStats stats;
+    for (const string& word : stop_words_) {
+        stats.stop_words_bytes += GetTreeNodeSize<string>() + GetHeapSize(word);
+    }
+    // писатель меняет копии только под write_mutex_
+    lock_guard lock(write_mutex_);
+    for (const Index& index : indexes_) {
+        stats.terms_bytes += index.terms.GetMemoryUsage();
+        // сегменты, общие для обеих копий, учитываются один раз
+        const PostingIndex* counted_postings = &index == &indexes_[1] ? &indexes_[0].word_to_document_freqs : nullptr;
+        stats.postings_bytes += index.word_to_document_freqs.GetMemoryUsage(counted_postings);
+        stats.posting_buffer_bytes += index.word_to_document_freqs.GetBufferMemoryUsage();
+        stats.forward_index_bytes += index.forward_index.GetMemoryUsage();
+        stats.documents_bytes += index.documents.GetMemoryUsage();
+        stats.attributes_bytes += index.attributes.GetMemoryUsage();
+        stats.document_ids_bytes += index.document_ids.GetMemoryUsage();
+    }
+    stats.total_bytes = stats.terms_bytes + stats.postings_bytes + stats.posting_buffer_bytes + stats.forward_index_bytes
+        + stats.documents_bytes + stats.attributes_bytes + stats.document_ids_bytes + stats.stop_words_bytes;
+    const Index& index = GetPublishedIndex();
+    stats.snapshot_bytes = index.snapshot_file ? index.snapshot_file->GetSize() : 0;
+    stats.term_count = index.terms.GetTermCount();
+    stats.posting_count = index.word_to_document_freqs.GetPostingCount();
+    stats.document_count = index.document_ids.size();
+    return stats;
+}
+
+const SearchServer::Index& SearchServer::GetPublishedIndex() const {
+    return indexes_[published_index_.load()];
+}
+
+
+SearchServer::IndexGuard::IndexGuard(const SearchServer& server)
+    : server_(server) {
+    // писатель мог опубликовать другую копию, пока счётчик увеличивался; тогда вход повторяется
+    while (true) {
+        index_ = server_.published_index_.load();
+        server_.reader_counts_[index_].value.fetch_add(1);
+        if (server_.published_index_.load() == index_) {
+            break;
         }
+        server_.reader_counts_[index_].value.fetch_sub(1);
     }
-    return {{set_of_plus_words.begin(), set_of_plus_words.end()}, {set_of_minus_words.begin(), set_of_minus_words.end()}};
 }
 
+SearchServer::IndexGuard::~IndexGuard() {
+    server_.reader_counts_[index_].value.fetch_sub(1);
+}
 
+const SearchServer::Index& SearchServer::IndexGuard::operator*() const {
+    return server_.indexes_[index_];
+}
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+const SearchServer::Index* SearchServer::IndexGuard::operator->() const {
+    return &server_.indexes_[index_];
 }
 
 
@@ -1,8 +1,25 @@
 #pragma once
 
 #include "document.h"
+#include "document_attributes.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "posting_index.h"
+#include "term_dictionary.h"
+#include "small_vector.h"
+#include "top_documents.h"
+#include "relevance_accumulator.h"
+#include "forward_index.h"
+#include "document_id_index.h"
+#include "array_view.h"
+#include "snapshot.h"
+#include "write_ahead_log.h"
+#include "query_cache.h"
+#include "batch_results.h"
+#include "thread_pool.h"
+#include "admission_queue.h"
+#include "tracing.h"
+#include "sorted_intersection.h"
+#include "memory_usage.h"
 
 #include <vector>
 #include <string>
@@ -16,14 +33,21 @@
 #include <algorithm>
 #include <utility>
 #include <stdexcept>
+#include <exception>
 #include <iterator>
 #include <execution>
 #include <future>
 #include <mutex>
+#include <thread>
 #include <type_traits>
+#include <memory>
+#include <atomic>
+#include <chrono>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+// Запросы можно выполнять из нескольких потоков одновременно с изменениями индекса:
+// читатели не блокируются, изменения выполняются по одному
 class SearchServer {
 public:
     template <typename StringContainer>
@@ -33,32 +57,132 @@ public:
     
     SearchServer(std::string_view stop_words_text);
 
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Даёт тот же индекс, что и AddDocument для каждого документа по порядку, но разбор текстов
+    // идёт параллельно. Если хотя бы один документ некорректен, не добавляется ни один
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;       
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+    // Фильтр по статусу и рейтингу проверяется по битовым картам при обходе постингов, без предиката
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const;
     
     template <typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const;
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, DocumentStatus status) const;
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, const DocumentFilter& filter) const;
+    
+    
+    // Выполняет пакет запросов на одной версии индекса. Слова всех запросов сортируются, и каждое
+    // различное слово ищется в словаре один раз; запросы выполняются параллельно частями, а результаты
+    // части пишутся в её буфер без выделения памяти на каждый запрос. Память занимают только найденные
+    // документы, сколь бы большим ни был SetMaxResultDocumentCount
+    BatchResults FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, DocumentStatus status = DocumentStatus::ACTUAL) const;
+    
+    using Deadline = std::chrono::steady_clock::time_point;
+    
+    // Ставит запрос в очередь пула потоков и сразу возвращает future с результатом. Когда принятых,
+    // но ещё не выполненных запросов SetMaxPendingQueries, вызов ждёт места, но не дольше deadline;
+    // не дождавшись, возвращает пустой результат с is_truncated. Поиск, не уложившийся в deadline,
+    // останавливается и отдаёт лучшие из просмотренных документов с is_truncated.
+    // Принятые запросы лежат в общей очереди пула: работники берут их, когда нет частей параллельных
+    // операций, а потоки, ждущие окончания ParallelFor, не берут их никогда.
+    // Не вызывать из задач пула сервера: ожидание места заняло бы работника
+    std::future<FindResult> SubmitFind(std::string raw_query, DocumentStatus status, Deadline deadline) const;
+    
+    void SetMaxPendingQueries(size_t max_count);
     
+    size_t GetPendingQueryCount() const;
+    
+    // Запросы SubmitFind, не дождавшиеся места в очереди до своего срока
+    uint64_t GetRejectedQueryCount() const;
     
     int GetDocumentCount() const;
     
-    std::set<int>::const_iterator begin() const;   
-    std::set<int>::const_iterator end() const;
+    void SetMaxResultDocumentCount(size_t max_count);
+    
+    struct PruningStats {
+        // постинги плюс-слов, которые были прочитаны
+        uint64_t scanned_postings = 0;
+        // постинги плюс-слов, пропущенные благодаря верхним оценкам релевантности
+        uint64_t skipped_postings = 0;
+    };
+    
+    PruningStats GetPruningStats() const;
+    
+    // Байты в куче вместе со служебными данными распределителя, по обеим копиям индекса.
+    // Данные из снимка лежат в отображённом файле и учитываются отдельно в snapshot_bytes
+    struct MemoryStats {
+        size_t terms_bytes = 0;
+        // сжатые сегменты постингов и частоты слов
+        size_t postings_bytes = 0;
+        size_t posting_buffer_bytes = 0;
+        size_t forward_index_bytes = 0;
+        size_t documents_bytes = 0;
+        size_t attributes_bytes = 0;
+        size_t document_ids_bytes = 0;
+        size_t stop_words_bytes = 0;
+        size_t total_bytes = 0;
+        // размер файла снимка; копии индекса отображают его с общими страницами
+        size_t snapshot_bytes = 0;
+        size_t term_count = 0;
+        // постинги документов, которые не удалены
+        size_t posting_count = 0;
+        size_t document_count = 0;
+    };
+    
+    // Размеры поддерживаются структурами индекса при изменениях, поэтому вызов не обходит индекс
+    // и его можно часто опрашивать; на время вызова изменения индекса ждут
+    MemoryStats GetMemoryStats() const;
+    
+    // Кэширует результаты запросов с фильтром по статусу или DocumentFilter: запросы, отличающиеся только порядком
+    // и повторами слов, считаются одинаковыми. Любое изменение индекса делает записи устаревшими.
+    // По умолчанию кэш выключен; capacity = 0 выключает его
+    void SetQueryCacheCapacity(size_t capacity);
+    
+    QueryCache::Stats GetQueryCacheStats() const;
     
-    const std::unordered_map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Параллельные операции сервера выполняются в его пуле потоков; по умолчанию работников столько,
+    // сколько аппаратных потоков. Нельзя вызывать одновременно с другими запросами к серверу
+    void SetWorkerCount(size_t worker_count);
+    
+    ThreadPool& GetThreadPool() const;
+    
+    // Обход не защищён от одновременных изменений индекса
+    DocumentIdIndex::Iterator begin() const;   
+    DocumentIdIndex::Iterator end() const;
+    
+    std::unordered_map<std::string_view, double> GetWordFrequencies(int document_id) const;
     
     void RemoveDocument(int document_id);
     
     template<typename ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy execution_type, int document_id);
+    
+    // Удаляет документы одним изменением индекса; отсутствующие идентификаторы пропускаются.
+    // Удалённые документы сразу исчезают из выдачи и из частот слов, а их постинги вычищаются
+    // уплотнением, когда их накопится заметная доля
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    
+    // Немедленно вычищает постинги удалённых документов
+    void CompactIndex();
+
+    // Документы, набор слов которых (без учёта частот) совпадает с набором слов документа с меньшим
+    // идентификатором, по возрастанию идентификаторов. Документы группируются по отпечаткам
+    // из прямого индекса, совпадение отпечатков перепроверяется сравнением слов
+    std::vector<int> FindDuplicates() const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
     
@@ -66,49 +190,253 @@ public:
     
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy execution_type, std::string_view raw_query, int document_id) const;
     
+    // MatchDocument для нескольких документов: запрос разбирается один раз, и все документы проверяются
+    // по одной копии индекса. Результаты идут в порядке document_ids; если какого-то документа нет,
+    // выбрасывается out_of_range. Параллельная версия распределяет документы по пулу потоков
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
+    
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::parallel_policy execution_type, std::string_view raw_query, const std::vector<int>& document_ids) const;
+    
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::execution::sequenced_policy execution_type, std::string_view raw_query, const std::vector<int>& document_ids) const;
+    
+    // Сохраняет индекс в файл. Удалённые документы в снимок не попадают, номера документов уплотняются
+    void SaveSnapshot(const std::string& path) const;
+    
+    // Отображает снимок в память и работает с ним без десериализации: постинги, прямой индекс,
+    // словарь и таблицы документов читаются прямо из файла. verify_checksums = false заменяет
+    // проверку контрольных сумм проверкой строения секций: все номера, смещения и коды остаются
+    // в границах массивов, поэтому повреждённый файл отвергается, а не читается за границами.
+    // Обе проверки читают секции целиком
+    static SearchServer LoadSnapshot(const std::string& path, bool verify_checksums = true);
+    
+    // Применяет к индексу записи журнала, которых ещё нет в загруженном снимке, и дальше пишет в журнал
+    // каждое изменение. fsync выполняется после каждых sync_record_count записей; 0 - только в SyncWriteAheadLog
+    void OpenWriteAheadLog(const std::string& path, size_t sync_record_count = 1);
+    
+    void SyncWriteAheadLog();
+    
+    // Атомарно заменяет снимок и очищает журнал. Снимок пишется во временный файл и переименовывается,
+    // поэтому его можно сохранять поверх файла, из которого загружен этот же сервер
+    void Checkpoint(const std::string& snapshot_path);
+    
 private:
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
     };
-    std::set<std::string> stop_words_;
-    std::unordered_set<std::string> all_words;
-    std::unordered_map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
-    std::set<int> document_ids_;
-    std::map<int, std::unordered_map<std::string_view, double> > id_to_word_freqs_;
+    
+    struct Index {
+        TermDictionary terms;
+        PostingIndex word_to_document_freqs;
+        // документы нумеруются подряд в порядке добавления; номер удалённого документа не переиспользуется
+        MappedVector<DocumentData> documents;
+        // статусы и рейтинги documents колонками для фильтров
+        DocumentAttributes attributes;
+        DocumentIdIndex document_ids;
+        ForwardIndex forward_index;
+        std::shared_ptr<MappedFile> snapshot_file;
+        // номер последней записи журнала, отражённой в индексе
+        uint64_t log_sequence_number = 0;
+        // растёт при каждом изменении индекса
+        uint64_t generation = 0;
+    };
+    
+    // Удерживает опубликованную копию индекса: пока охрана жива, писатель эту копию не меняет
+    class IndexGuard {
+    public:
+        explicit IndexGuard(const SearchServer& server);
+        
+        IndexGuard(const IndexGuard&) = delete;
+        IndexGuard& operator=(const IndexGuard&) = delete;
+        
+        ~IndexGuard();
+        
+        const Index& operator*() const;
+        const Index* operator->() const;
+        
+    private:
+        const SearchServer& server_;
+        size_t index_;
+    };
+    
+    struct alignas(64) ReaderCount {
+        std::atomic<size_t> value{0};
+    };
+    
+    std::set<std::string, std::less<>> stop_words_;
+    // Схема left-right: читатели работают с опубликованной копией, писатель меняет вторую,
+    // публикует её и, дождавшись ухода читателей из старой, повторяет то же изменение на ней
+    Index indexes_[2];
+    std::atomic<size_t> published_index_{0};
+    mutable ReaderCount reader_counts_[2];
+    mutable std::mutex write_mutex_;
+    std::unique_ptr<WriteAheadLog> log_;
+    // Слияние сегментов постингов строится в пуле, не больше одного за раз. План и флаг меняются
+    // под write_mutex_, готовый сегмент задача оставляет в merged_segment_
+    PostingIndex::SegmentMerge segment_merge_;
+    bool is_merging_segments_ = false;
+    std::mutex merged_segment_mutex_;
+    std::shared_ptr<PostingSegment> merged_segment_;
+    std::atomic<size_t> max_result_document_count_{MAX_RESULT_DOCUMENT_COUNT};
+    mutable std::atomic<uint64_t> scanned_postings_{0};
+    mutable std::atomic<uint64_t> skipped_postings_{0};
+    mutable QueryCache query_cache_;
+    // объявлена до пула: задачи пула освобождают места в очереди, поэтому пул уничтожается первым
+    mutable AdmissionQueue admission_queue_{DEFAULT_MAX_PENDING_QUERIES};
+    std::unique_ptr<ThreadPool> thread_pool_ = std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
+    
+    SearchServer(const SnapshotReader& reader, const SnapshotReader& mirror_reader);
+    
+    // Проверяет строение секций снимка, загруженного без проверки контрольных сумм
+    static void ValidateSnapshot(const SnapshotReader& reader);
+    
+    static void LoadIndex(Index& index, const SnapshotReader& reader);
+    
+    // Вызывается под write_mutex_; operation должна одинаково менять обе копии
+    template <typename Operation>
+    void ModifyIndex(Operation operation);
+    
+    // Копия, которую видит писатель; вызывается под write_mutex_
+    const Index& GetPublishedIndex() const;
+    
+    static void AddDocumentToIndex(Index& index, int document_id, const std::vector<std::string_view>& words, DocumentStatus status, int rating);
+    
+    // Изменения с записью в журнал; replayed_sequence_number - номер воспроизводимой записи журнала
+    // или 0 для нового изменения
+    void ApplyAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings, uint64_t replayed_sequence_number);
+    void ApplyAddDocuments(const std::vector<NewDocument>& documents, uint64_t replayed_sequence_number);
+    void ApplyRemoveDocuments(const std::vector<int>& document_ids, uint64_t replayed_sequence_number);
+    
+    struct RemovedDocument {
+        int id;
+        uint32_t ordinal;
+        std::vector<TermId> terms;
+    };
+    
+    // Находит документы в опубликованной копии; вызывается под write_mutex_
+    std::vector<RemovedDocument> FindRemovedDocuments(const std::vector<int>& document_ids) const;
+    
+    static void RemoveDocumentsFromIndex(ThreadPool* thread_pool, Index& index, const std::vector<RemovedDocument>& removed_documents);
+    
+    // Ставит в пул следующий шаг слияния сегментов постингов, если его пора делать и другой
+    // не строится. Построенный сегмент ставит в индекс сама задача, если write_mutex_ свободен,
+    // иначе - следующее добавление документов. Вызывается под write_mutex_
+    void ScheduleSegmentMerge();
+    
+    // Построенный сегмент слияния или nullptr; вызывается под write_mutex_ перед изменением индекса,
+    // в котором сегмент попадёт в обе копии через ApplySegmentMerge
+    std::shared_ptr<PostingSegment> TakeMergedSegment();
+    
+    void ApplySegmentMerge(Index& index, const std::shared_ptr<PostingSegment>& merged_segment) const;
 
-    bool IsStopWord(const std::string& word) const;
+    // документы раскладываются по 2^DUPLICATE_PART_BITS частям по старшим битам отпечатка,
+    // части обрабатываются независимо
+    static const size_t DUPLICATE_PART_BITS = 6;
+    
+    // Единое правило выбора параллельности: пул отдаётся только для execution::par и только когда
+    // в нём есть свободные работники. Под нагрузкой работники уже заняты другими запросами, и деление
+    // одной операции на части лишь отнимало бы у них время, поэтому операция выполняется в своём потоке
+    template <typename ExecutionPolicy>
+    ThreadPool* SelectThreadPool(ExecutionPolicy execution_type) const;
+
+    bool IsStopWord(std::string_view word) const;
     
     static bool IsValidWord(std::string_view word);
 
-    std::vector<std::string> SplitIntoWordsNoStop(std::string_view text) const;
+    // Заполняет words без выделения памяти, если ёмкости буфера достаточно
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     struct QueryWord {
-        std::string data;
+        std::string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // is_valid - результат проверки слова токенизатором
+    QueryWord ParseQueryWord(std::string_view text, bool is_valid) const;
+    
+    // Проверяет слово и отделяет минус, не заполняя is_stop
+    static QueryWord ParseQueryWordSyntax(std::string_view text, bool is_valid);
+
+    static const size_t QUERY_INLINE_TERM_COUNT = 16;
+    using QueryTerms = SmallVector<TermId, QUERY_INLINE_TERM_COUNT>;
 
+    // Слова запроса, отсутствующие в индексе, отбрасываются при разборе.
+    // Номера слов отсортированы и уникальны; обычный запрос разбирается без обращений к куче
     struct Query {
-        std::vector<std::string> plus_words;
-        std::vector<std::string> minus_words;
+        QueryTerms plus_terms;
+        QueryTerms minus_terms;
     };
     
 
-    Query ParseQuery(std::string_view text) const;
+    Query ParseQuery(const Index& index, std::string_view text) const;
+    
+    static std::string MakeQueryCacheKey(const Query& query, const DocumentFilter& filter, size_t max_count);
         
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
-
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const; 
+    struct ScoredTerm {
+        TermId term;
+        size_t document_freq;
+        double inverse_document_freq;
+        // наибольший вклад слова в релевантность документа
+        double max_score;
+    };
+    
+    // Плюс-слова, встречающиеся в индексе, по убыванию max_score. Вклады слов в релевантность
+    // суммируются в этом порядке и при полном переборе, и при отсечении, поэтому результаты совпадают
+    using ScoredTerms = SmallVector<ScoredTerm, QUERY_INLINE_TERM_COUNT>;
+    
+    static ScoredTerms ScoreTerms(const Index& index, const Query& query);
+    
+    static const size_t DEFAULT_MAX_PENDING_QUERIES = 1024;
+    static constexpr Deadline NO_DEADLINE = Deadline::max();
+    
+    static bool IsExpired(Deadline deadline);
+    
+    // Поиск для SubmitFind; срок проверяется между окнами обхода постингов
+    FindResult FindTopDocumentsUntil(std::string_view raw_query, DocumentStatus status, Deadline deadline) const;
+    
+    static const size_t PARALLEL_MIN_PART_SIZE = 16384;
+    static const size_t PARALLEL_PARTS_PER_THREAD = 4;
+    static const size_t PARALLEL_MIN_MATCH_TERM_COUNT = 256;
+    // запросов пакета в одной части FindTopDocumentsBatch
+    static const size_t BATCH_PART_QUERY_COUNT = 32;
+    
+    // Слова запроса, которые есть в документе, по возрастанию номеров. Пересечение ведётся блоками с SIMD;
+    // если thread_pool != nullptr, слова запроса делятся на части по PARALLEL_MIN_MATCH_TERM_COUNT
+    static void IntersectTerms(ThreadPool* thread_pool, const QueryTerms& query_terms, ArrayView<TermId> document_terms,
+                               std::vector<TermId>& common_terms);
+    
+    // Совпавшие плюс-слова документа по алфавиту или пустой список, если в документе есть минус-слово
+    static std::tuple<std::vector<std::string_view>, DocumentStatus> MatchTerms(ThreadPool* thread_pool, const Index& index,
+                                                                              const Query& query, uint32_t ordinal);
+    
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(ThreadPool* thread_pool, std::string_view raw_query,
+                                                                                          const std::vector<int>& document_ids) const;
+    
+    // Буфер переиспользуется всеми запросами, выполняемыми в потоке
+    static RelevanceAccumulator& GetRelevanceAccumulator();
 
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy execution_type, const Query& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocumentsInIndex(ExecutionPolicy execution_type, const Index& index, const Query& query, DocumentPredicate document_predicate, size_t max_count) const;
+    
+    // thread_pool = nullptr - поиск в вызывающем потоке. is_truncated - поиск остановлен по deadline
+    template <typename DocumentPredicate>
+    TopDocuments FindAllDocuments(ThreadPool* thread_pool, const Index& index, const Query& query, DocumentPredicate document_predicate, size_t max_count,
+                                  Deadline deadline, bool& is_truncated) const;
+    
+    static const uint32_t PRUNING_WINDOW_SIZE = 4096;
+    // Во сколько раз поиск постинга у кандидата дороже просмотра постинга подряд
+    static const size_t PRUNING_LOOKUP_COST = 4;
+    
+    // Добавляет в top_documents документы с номерами из [first_ordinal, last_ordinal). Возвращает false, если
+    // deadline наступил раньше: тогда учтены только документы окон, просмотренных до этого целиком
+    template <typename DocumentPredicate>
+    bool FindDocumentsInRange(const Index& index, const Query& query, const ScoredTerms& scored_terms,
+                              uint32_t first_ordinal, uint32_t last_ordinal, DocumentPredicate document_predicate, Deadline deadline,
+                              TopDocuments& top_documents) const;
 
 };
 
@@ -125,9 +453,7 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, DocumentStatus status) const {
-        return FindTopDocuments(execution_type, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
+    return FindTopDocuments(execution_type, raw_query, DocumentFilter{status});
 }
 
 template <typename ExecutionPolicy>
@@ -135,6 +461,20 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy execution_t
         return FindTopDocuments(execution_type, raw_query, DocumentStatus::ACTUAL);
 }
 
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, const DocumentFilter& filter) const {
+    TRACE_OPERATION(FIND_TOP_DOCUMENTS);
+    const size_t max_count = max_result_document_count_.load();
+    const IndexGuard index(*this);
+    const auto query = ParseQuery(*index, raw_query);
+    if (!query_cache_.IsEnabled()) {
+        return FindTopDocumentsInIndex(execution_type, *index, query, filter, max_count);
+    }
+    return query_cache_.GetOrCompute(MakeQueryCacheKey(query, filter, max_count), index->generation, [&] {
+        return FindTopDocumentsInIndex(execution_type, *index, query, filter, max_count);
+    });
+}
+
 
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
@@ -143,126 +483,271 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocuments(execution_type, raw_query, document_predicate, max_result_document_count_.load());
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy execution_type, std::string_view raw_query, DocumentPredicate document_predicate, size_t max_count) const {
+    TRACE_OPERATION(FIND_TOP_DOCUMENTS);
+    const IndexGuard index(*this);
+    const auto query = ParseQuery(*index, raw_query);
+    return FindTopDocumentsInIndex(execution_type, *index, query, document_predicate, max_count);
+}
 
-    const auto query = ParseQuery(raw_query);
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsInIndex(ExecutionPolicy execution_type, const Index& index, const Query& query, DocumentPredicate document_predicate, size_t max_count) const {
+    bool is_truncated = false;
+    TopDocuments top_documents = FindAllDocuments(SelectThreadPool(execution_type), index, query, document_predicate, max_count, NO_DEADLINE, is_truncated);
+    TRACE_STAGE(RANKING);
+    return top_documents.Extract();
+}
 
-    std::vector<Document> matched_documents;
+template <typename ExecutionPolicy>
+ThreadPool* SearchServer::SelectThreadPool([[maybe_unused]] ExecutionPolicy execution_type) const {
     if constexpr (std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>) {
-        matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
+        return thread_pool_->GetIdleWorkerCount() > 0 ? thread_pool_.get() : nullptr;
     } else {
-         matched_documents = FindAllDocuments(query, document_predicate);
-    }
-    
-    static const double EPSILON = 1e-6;
-    std::sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-            return lhs.rating > rhs.rating;
-        } else {
-            return lhs.relevance > rhs.relevance;
-        }
-    });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+        return nullptr;
     }
+}
 
-    return matched_documents;
+inline bool SearchServer::IsExpired(Deadline deadline) {
+    return deadline != NO_DEADLINE && std::chrono::steady_clock::now() >= deadline;
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const {
-
-    std::map<int, double> document_to_relevance;
-    for (const std::string& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
-        }
+TopDocuments SearchServer::FindAllDocuments(ThreadPool* thread_pool, const Index& index, const Query& query, DocumentPredicate document_predicate, size_t max_count,
+                                            Deadline deadline, bool& is_truncated) const {
+    if (IsExpired(deadline)) {
+        is_truncated = true;
+        return TopDocuments(max_count);
     }
+    const ScoredTerms scored_terms = ScoreTerms(index, query);
     
-
-    for (const std::string& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+    // Документы делятся на диапазоны номеров; каждый диапазон целиком считается одним потоком
+    // без блокировок, поэтому параллельность не зависит от количества слов в запросе.
+    // Частей тем больше, чем больше свободных работников, вызывающий поток тоже считает свою долю
+    const uint32_t document_count = index.documents.size();
+    const size_t thread_count = thread_pool == nullptr ? 1 : thread_pool->GetIdleWorkerCount() + 1;
+    const size_t part_count = thread_count == 1 ? 1 : std::max<size_t>(1, std::min<size_t>(
+        thread_count * PARALLEL_PARTS_PER_THREAD,
+        (document_count + PARALLEL_MIN_PART_SIZE - 1) / PARALLEL_MIN_PART_SIZE));
+    if (part_count == 1) {
+        TopDocuments top_documents(max_count);
+        is_truncated = !FindDocumentsInRange(index, query, scored_terms, 0, document_count, document_predicate, deadline, top_documents);
+        return top_documents;
+    }
+    const uint32_t part_size = (document_count + part_count - 1) / part_count;
+    
+    std::vector<TopDocuments> partial_tops(part_count, TopDocuments(max_count));
+    std::atomic<bool> is_any_truncated{false};
+    thread_pool->ParallelFor(part_count, [&](size_t part) {
+        const uint32_t first = std::min<uint32_t>(part * part_size, document_count);
+        const uint32_t last = std::min<uint32_t>(first + part_size, document_count);
+        if (!FindDocumentsInRange(index, query, scored_terms, first, last, document_predicate, deadline, partial_tops[part])) {
+            is_any_truncated.store(true);
         }
+    });
+    is_truncated = is_any_truncated.load();
+    
+    TRACE_STAGE(RANKING);
+    TopDocuments top_documents(max_count);
+    for (const auto& partial_top : partial_tops) {
+        top_documents.Merge(partial_top);
     }
+    return top_documents;
+}
 
-    std::vector<Document> matched_documents;
-    matched_documents.reserve(document_to_relevance.size());
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+template <typename DocumentPredicate>
+bool SearchServer::FindDocumentsInRange(const Index& index, const Query& query, const ScoredTerms& scored_terms,
+                                        uint32_t first_ordinal, uint32_t last_ordinal, DocumentPredicate document_predicate, Deadline deadline,
+                                        TopDocuments& top_documents) const {
+    if (IsExpired(deadline)) {
+        return false;
+    }
+    // Курсоры плюс-слов идут в порядке scored_terms, за ними - курсоры минус-слов
+    static thread_local std::vector<PostingCursor> cursors;
+    cursors.clear();
+    for (const ScoredTerm& scored_term : scored_terms) {
+        cursors.push_back(index.word_to_document_freqs.GetCursor(scored_term.term));
+    }
+    for (const TermId term : query.minus_terms) {
+        cursors.push_back(index.word_to_document_freqs.GetCursor(term));
+    }
+    for (PostingCursor& cursor : cursors) {
+        cursor.SkipTo(first_ordinal);
     }
-    return matched_documents;
-} 
-
     
-template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy execution_type, const Query& query, DocumentPredicate document_predicate) const {
-
-    const size_t buckets_count = 3000;
-    ConcurrentMap<int, double> document_to_relevance(buckets_count);
+    // DocumentFilter проверяется по колонкам атрибутов: один бит карты статуса вместо строки документа
+    // и предиката, удалённых документов на карте нет
+    [[maybe_unused]] DocumentAttributes::Matcher filter_matcher;
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+        filter_matcher = index.attributes.GetMatcher(document_predicate);
+    }
     
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [&] (const auto& word) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            return;
+    // remaining_max_scores[i] - наибольший возможный вклад слов начиная с i-го
+    const size_t term_count = scored_terms.size();
+    SmallVector<double, QUERY_INLINE_TERM_COUNT + 1> remaining_max_scores;
+    for (size_t i = 0; i <= term_count; ++i) {
+        remaining_max_scores.push_back(0.0);
+    }
+    for (size_t i = term_count; i > 0; --i) {
+        remaining_max_scores[i - 1] = remaining_max_scores[i] + scored_terms[i - 1].max_score;
+    }
+    
+    // MaxScore: слова [0, essential_count) обходятся целиком и порождают кандидатов. Остальные слова
+    // вместе не могут дать документу релевантность порога, поэтому для них постинги только ищутся
+    // у кандидатов, пока оценка сверху ещё позволяет кандидату попасть в выдачу
+    size_t essential_count = term_count;
+    uint64_t scanned_postings = 0;
+    uint64_t passed_postings = 0;
+    uint64_t found_postings = 0;
+    auto& document_to_relevance = GetRelevanceAccumulator();
+    for (uint32_t window_first = first_ordinal; window_first < last_ordinal && essential_count > 0;) {
+        // окно либо просматривается целиком, либо не начинается: иначе релевантности кандидатов были бы неполными
+        if (IsExpired(deadline)) {
+            scanned_postings_ += scanned_postings + found_postings;
+            skipped_postings_ += passed_postings - found_postings;
+            TRACE_COUNT(POSTINGS_SCANNED, scanned_postings + found_postings);
+            TRACE_COUNT(POSTINGS_SKIPPED, passed_postings - found_postings);
+            return false;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+        const uint32_t window_last = window_first + std::min<uint32_t>(PRUNING_WINDOW_SIZE, last_ordinal - window_first);
+        document_to_relevance.Reset(window_last - window_first);
+        
+        {
+            TRACE_STAGE(MINUS_WORDS);
+            for (size_t i = term_count; i < cursors.size(); ++i) {
+                cursors[i].ForEachBefore(window_last, [&](const Posting& posting) {
+                    document_to_relevance.Exclude(posting.ordinal - window_first);
+                });
             }
         }
-    });
-    
-    const size_t buckets_count_for_deleted_ids = 100;
-    ConcurrentMap<int, bool> concurrent_deleted_ids(buckets_count_for_deleted_ids); // используем map как set
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [&] (const auto& word) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            return;
+        {
+            TRACE_STAGE(POSTING_SCAN);
+            for (size_t i = 0; i < essential_count; ++i) {
+                const double inverse_document_freq = scored_terms[i].inverse_document_freq;
+                cursors[i].ForEachBefore(window_last, [&](const Posting& posting) {
+                    ++scanned_postings;
+                    if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+                        if (filter_matcher(posting.ordinal) && !document_to_relevance.IsExcluded(posting.ordinal - window_first)) {
+                            document_to_relevance.Add(posting.ordinal - window_first, posting.term_freq * inverse_document_freq);
+                        }
+                    } else {
+                        if (index.word_to_document_freqs.IsRemoved(posting.ordinal) || document_to_relevance.IsExcluded(posting.ordinal - window_first)) {
+                            return;
+                        }
+                        const auto& document_data = index.documents[posting.ordinal];
+                        if (document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                            document_to_relevance.Add(posting.ordinal - window_first, posting.term_freq * inverse_document_freq);
+                        }
+                    }
+                });
+            }
+        }
+        
+        // Когда кандидатов много, постинги неосновных слов дешевле просмотреть подряд,
+        // добавляя вклады только уже найденным кандидатам
+        double window_nonessential_postings = 0.0;
+        for (size_t i = essential_count; i < term_count; ++i) {
+            window_nonessential_postings += scored_terms[i].document_freq;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            concurrent_deleted_ids[document_id];
+        window_nonessential_postings *= (window_last - window_first) * 1.0 / index.documents.size();
+        const bool scan_nonessential = document_to_relevance.GetTouchedCount() * (term_count - essential_count) * PRUNING_LOOKUP_COST
+                                       >= window_nonessential_postings;
+        TRACE_COUNT(DOCUMENTS_SCORED, document_to_relevance.GetTouchedCount());
+        if (essential_count == term_count || scan_nonessential) {
+            {
+                TRACE_STAGE(POSTING_SCAN);
+                for (size_t i = essential_count; i < term_count; ++i) {
+                    const double inverse_document_freq = scored_terms[i].inverse_document_freq;
+                    cursors[i].ForEachBefore(window_last, [&](const Posting& posting) {
+                        ++scanned_postings;
+                        document_to_relevance.AddIfScored(posting.ordinal - window_first, posting.term_freq * inverse_document_freq);
+                    });
+                }
+            }
+            TRACE_STAGE(RANKING);
+            document_to_relevance.ForEachScored([&](uint32_t offset, double relevance) {
+                const auto& document_data = index.documents[window_first + offset];
+                top_documents.Add({document_data.id, relevance, document_data.rating});
+            });
+        } else {
+            // кандидаты идут по возрастанию номеров, чтобы курсоры неосновных слов двигались только вперёд
+            TRACE_STAGE(POSTING_SCAN);
+            document_to_relevance.ForEachScoredInOrder([&](uint32_t offset, double relevance) {
+                const uint32_t ordinal = window_first + offset;
+                for (size_t i = essential_count; i < term_count; ++i) {
+                    if (relevance + remaining_max_scores[i] < top_documents.GetMinRelevance() - RELEVANCE_EPSILON) {
+                        return;
+                    }
+                    passed_postings += cursors[i].SkipTo(ordinal);
+                    const Posting* posting = cursors[i].Get();
+                    if (posting != nullptr && posting->ordinal == ordinal) {
+                        ++found_postings;
+                        relevance += posting->term_freq * scored_terms[i].inverse_document_freq;
+                    }
+                }
+                const auto& document_data = index.documents[ordinal];
+                top_documents.Add({document_data.id, relevance, document_data.rating});
+            });
         }
-    });
-    
-    auto deleted_ids = concurrent_deleted_ids.BuildOrdinaryMap();
-
-    std::vector<Document> matched_documents;
-    matched_documents.reserve(GetDocumentCount());
-    for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        if (deleted_ids.count(document_id)) {
-            continue;
+        
+        for (size_t i = essential_count; i < term_count; ++i) {
+            passed_postings += cursors[i].SkipTo(window_last);
         }
-        matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+        const double threshold = top_documents.GetMinRelevance() - RELEVANCE_EPSILON;
+        while (essential_count > 0 && remaining_max_scores[essential_count - 1] < threshold) {
+            --essential_count;
+        }
+        window_first = window_last;
+    }
+    // все слова стали неосновными: оставшиеся документы диапазона в выдачу не попадут
+    for (size_t i = 0; i < term_count; ++i) {
+        passed_postings += cursors[i].SkipTo(last_ordinal);
     }
-    return matched_documents;
+    
+    scanned_postings_ += scanned_postings + found_postings;
+    skipped_postings_ += passed_postings - found_postings;
+    TRACE_COUNT(POSTINGS_SCANNED, scanned_postings + found_postings);
+    TRACE_COUNT(POSTINGS_SKIPPED, passed_postings - found_postings);
+    return true;
 }
 
 
 
 template<typename ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy execution_type, int document_id) {
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
-    
-    std::vector<std::string> words_to_delete;
-    words_to_delete.reserve(all_words.size());
-    for(const auto& [word, _]: id_to_word_freqs_[document_id]) {
-        words_to_delete.push_back(word);
+    TRACE_OPERATION(REMOVE_DOCUMENTS);
+    std::lock_guard lock(write_mutex_);
+    const auto removed_documents = FindRemovedDocuments({document_id});
+    if (removed_documents.empty()) {
+        return;
     }
-    
-    std::for_each(execution_type, words_to_delete.begin(), words_to_delete.end(), [this, document_id] (const std::string& word) {
-        word_to_document_freqs_[word].erase(document_id);
-    }); 
-    
-    id_to_word_freqs_.erase(document_id);
+    uint64_t log_sequence_number = GetPublishedIndex().log_sequence_number;
+    if (log_) {
+        TRACE_STAGE(WRITE_AHEAD_LOG);
+        log_sequence_number = log_->AppendRemoveDocument(document_id);
+    }
+    TRACE_STAGE(INDEX_UPDATE);
+    ModifyIndex([&](Index& index) {
+        RemoveDocumentsFromIndex(SelectThreadPool(execution_type), index, removed_documents);
+        index.log_sequence_number = log_sequence_number;
+    });
+}
+
+template <typename Operation>
+void SearchServer::ModifyIndex(Operation operation) {
+    const size_t published = published_index_.load();
+    const size_t standby = 1 - published;
+    const uint64_t generation = indexes_[published].generation + 1;
+    // в резервной копии читателей нет: писатель дождался их ухода при прошлом изменении
+    operation(indexes_[standby]);
+    indexes_[standby].generation = generation;
+    published_index_.store(standby);
+    while (reader_counts_[published].value.load() > 0) {
+        std::this_thread::yield();
+    }
+    operation(indexes_[published]);
+    indexes_[published].generation = generation;
 }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// Вектор, который хранит первые N элементов внутри себя и обращается к куче только при переполнении
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(std::is_trivially_copyable_v<T>, "SmallVector supports only trivially copyable types");
+
+public:
+    void push_back(const T& value) {
+        if (IsOnHeap()) {
+            heap_.push_back(value);
+        } else if (size_ < N) {
+            inline_[size_++] = value;
+        } else {
+            heap_.reserve(2 * N);
+            heap_.assign(inline_.begin(), inline_.end());
+            heap_.push_back(value);
+        }
+    }
+
+    // Только уменьшение размера
+    void resize(size_t size) {
+        if (IsOnHeap()) {
+            heap_.resize(size);
+            size_ = 0;
+        } else {
+            size_ = size;
+        }
+    }
+
+    T* begin() {
+        return IsOnHeap() ? heap_.data() : inline_.data();
+    }
+
+    T* end() {
+        return begin() + size();
+    }
+
+    const T* begin() const {
+        return IsOnHeap() ? heap_.data() : inline_.data();
+    }
+
+    const T* end() const {
+        return begin() + size();
+    }
+
+    T& operator[](size_t index) {
+        return begin()[index];
+    }
+
+    const T& operator[](size_t index) const {
+        return begin()[index];
+    }
+
+    size_t size() const {
+        return IsOnHeap() ? heap_.size() : size_;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    std::array<T, N> inline_;
+    size_t size_ = 0;
+    std::vector<T> heap_;
+
+    bool IsOnHeap() const {
+        return !heap_.empty();
+    }
+};
@@ -0,0 +1,175 @@
+#include "snapshot.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P'};
+const size_t SECTION_ALIGNMENT = 8;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t header_checksum;
+};
+
+size_t GetHeaderSize() {
+    return sizeof(SnapshotHeader) + static_cast<size_t>(SnapshotSection::COUNT) * 3 * sizeof(uint64_t);
+}
+
+} // namespace
+
+uint64_t ComputeChecksum(const char* data, size_t size, uint64_t checksum) {
+    // FNV-1a
+    for (size_t i = 0; i < size; ++i) {
+        checksum ^= static_cast<unsigned char>(data[i]);
+        checksum *= 1099511628211ull;
+    }
+    return checksum;
+}
+
+
+MappedFile::MappedFile(const string& path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        throw runtime_error("Cannot open snapshot "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd_, &file_stat) != 0) {
+        close(fd_);
+        throw runtime_error("Cannot stat snapshot "s + path);
+    }
+    Map(file_stat.st_size);
+}
+
+MappedFile::MappedFile(int fd, size_t size) {
+    fd_ = dup(fd);
+    if (fd_ < 0) {
+        throw runtime_error("Cannot duplicate snapshot descriptor"s);
+    }
+    Map(size);
+}
+
+void MappedFile::Map(size_t size) {
+    size_ = size;
+    if (size_ > 0) {
+        void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED) {
+            close(fd_);
+            throw runtime_error("Cannot map snapshot"s);
+        }
+        data_ = static_cast<char*>(data);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+    close(fd_);
+}
+
+shared_ptr<MappedFile> MappedFile::MapAgain() const {
+    return shared_ptr<MappedFile>(new MappedFile(fd_, size_));
+}
+
+char* MappedFile::GetData() const {
+    return data_;
+}
+
+size_t MappedFile::GetSize() const {
+    return size_;
+}
+
+
+SnapshotWriter::SnapshotWriter(const string& path)
+    : path_(path)
+    , out_(path, ios::binary | ios::trunc)
+    , sections_(static_cast<size_t>(SnapshotSection::COUNT)) {
+    if (!out_) {
+        throw runtime_error("Cannot create snapshot "s + path);
+    }
+    const string placeholder(GetHeaderSize(), '\0');
+    out_.write(placeholder.data(), placeholder.size());
+    offset_ = placeholder.size();
+}
+
+void SnapshotWriter::WriteSection(SnapshotSection section, const char* data, size_t size) {
+    const size_t padding = (SECTION_ALIGNMENT - offset_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT;
+    const char zeros[SECTION_ALIGNMENT] = {};
+    out_.write(zeros, padding);
+    offset_ += padding;
+
+    sections_[static_cast<size_t>(section)] = {offset_, size, ComputeChecksum(data, size)};
+    out_.write(data, size);
+    offset_ += size;
+}
+
+void SnapshotWriter::Finish() {
+    SnapshotHeader header;
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.section_count = sections_.size();
+    header.header_checksum = ComputeChecksum(reinterpret_cast<const char*>(sections_.data()), sections_.size() * sizeof(SectionEntry));
+
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.write(reinterpret_cast<const char*>(sections_.data()), sections_.size() * sizeof(SectionEntry));
+    out_.close();
+    if (!out_) {
+        throw runtime_error("Cannot write snapshot"s);
+    }
+    const int fd = open(path_.c_str(), O_RDONLY);
+    const bool is_synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!is_synced) {
+        throw runtime_error("Cannot sync snapshot "s + path_);
+    }
+}
+
+
+SnapshotReader::SnapshotReader(shared_ptr<MappedFile> file, bool verify_checksums)
+    : file_(move(file)) {
+    const char* data = file_->GetData();
+    const size_t size = file_->GetSize();
+    if (size < GetHeaderSize()) {
+        throw invalid_argument("Snapshot is truncated"s);
+    }
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw invalid_argument("Not a search server snapshot"s);
+    }
+    if (header.version != SNAPSHOT_VERSION || header.section_count != static_cast<uint32_t>(SnapshotSection::COUNT)) {
+        throw invalid_argument("Unsupported snapshot version "s + to_string(header.version));
+    }
+
+    sections_.resize(header.section_count);
+    memcpy(sections_.data(), data + sizeof(header), sections_.size() * sizeof(SnapshotWriter::SectionEntry));
+    if (ComputeChecksum(reinterpret_cast<const char*>(sections_.data()), sections_.size() * sizeof(SnapshotWriter::SectionEntry)) != header.header_checksum) {
+        throw invalid_argument("Snapshot header is corrupted"s);
+    }
+    for (const auto& section : sections_) {
+        if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > size || section.size > size - section.offset) {
+            throw invalid_argument("Snapshot section is out of bounds"s);
+        }
+        if (verify_checksums && ComputeChecksum(data + section.offset, section.size) != section.checksum) {
+            throw invalid_argument("Snapshot checksum mismatch"s);
+        }
+    }
+}
+
+const shared_ptr<MappedFile>& SnapshotReader::GetFile() const {
+    return file_;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Формат файла снимка: заголовок с таблицей секций, затем секции, выровненные по 8 байт.
+// Секции - это массивы в том же виде, в каком их использует индекс, поэтому после mmap
+// с ними можно работать напрямую
+enum class SnapshotSection : uint32_t {
+    STOP_WORD_CHARS,
+    STOP_WORD_OFFSETS,
+    TERM_CHARS,
+    TERM_OFFSETS,
+    TERM_HASH_TABLE,
+    DOCUMENT_FREQS,
+    POSTING_DATA,
+    POSTING_BLOCKS,
+    POSTING_RANGES,
+    POSTING_TERM_FREQS,
+    DOCUMENTS,
+    DOCUMENT_RATINGS,
+    DOCUMENT_STATUS_BITMAPS,
+    DOCUMENT_IDS,
+    FORWARD_OFFSETS,
+    FORWARD_TERMS,
+    FORWARD_FINGERPRINTS,
+    LOG_SEQUENCE_NUMBER,
+    MAX_TERM_FREQS,
+    COUNT,
+};
+
+const uint32_t SNAPSHOT_VERSION = 8;
+
+uint64_t ComputeChecksum(const char* data, size_t size, uint64_t checksum = 14695981039346656037ull);
+
+// Файл, отображённый в память с MAP_PRIVATE: изменения остаются в памяти процесса и не попадают в файл
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    char* GetData() const;
+
+    size_t GetSize() const;
+
+    // Ещё одно отображение того же файла: страницы общие, пока их не изменят через одно из отображений
+    std::shared_ptr<MappedFile> MapAgain() const;
+
+private:
+    int fd_ = -1;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+
+    MappedFile(int fd, size_t size);
+
+    void Map(size_t size);
+};
+
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+
+    template <typename T>
+    void WriteSection(SnapshotSection section, const std::vector<T>& values);
+
+    void WriteSection(SnapshotSection section, const char* data, size_t size);
+
+    // Дописывает заголовок и сбрасывает файл на диск; без вызова Finish файл не пройдёт проверку при загрузке
+    void Finish();
+
+private:
+    struct SectionEntry {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t checksum = 0;
+    };
+
+    std::string path_;
+    std::ofstream out_;
+    std::vector<SectionEntry> sections_;
+    uint64_t offset_ = 0;
+
+    friend class SnapshotReader;
+};
+
+class SnapshotReader {
+public:
+    // Проверяет заголовок; контрольные суммы секций - только при verify_checksums,
+    // потому что для этого нужно прочитать весь файл
+    SnapshotReader(std::shared_ptr<MappedFile> file, bool verify_checksums);
+
+    template <typename T>
+    std::pair<T*, size_t> GetSection(SnapshotSection section) const;
+
+    const std::shared_ptr<MappedFile>& GetFile() const;
+
+private:
+    std::shared_ptr<MappedFile> file_;
+    std::vector<SnapshotWriter::SectionEntry> sections_;
+};
+
+
+template <typename T>
+void SnapshotWriter::WriteSection(SnapshotSection section, const std::vector<T>& values) {
+    WriteSection(section, reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+std::pair<T*, size_t> SnapshotReader::GetSection(SnapshotSection section) const {
+    const auto& entry = sections_[static_cast<size_t>(section)];
+    return {reinterpret_cast<T*>(file_->GetData() + entry.offset), entry.size / sizeof(T)};
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "array_view.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace intersection_detail {
+
+// Если один массив длиннее другого во столько раз, каждый элемент короткого ищется в длинном
+// двоичным поиском: это дешевле, чем просматривать длинный массив целиком
+const size_t SEARCH_SIZE_RATIO = 32;
+
+const size_t BLOCK_SIZE = 4;
+
+// Маска элементов блока lhs, которые есть в блоке rhs: бит i соответствует lhs[i]
+#if defined(__SSE2__)
+inline uint32_t MatchBlocks(const uint32_t* lhs, const uint32_t* rhs) {
+    const __m128i lhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs));
+    const __m128i rhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs));
+    // каждый элемент lhs сравнивается со всеми четырьмя элементами rhs за четыре сдвига по кругу
+    const __m128i matches = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(lhs_block, rhs_block),
+                     _mm_cmpeq_epi32(lhs_block, _mm_shuffle_epi32(rhs_block, _MM_SHUFFLE(0, 3, 2, 1)))),
+        _mm_or_si128(_mm_cmpeq_epi32(lhs_block, _mm_shuffle_epi32(rhs_block, _MM_SHUFFLE(1, 0, 3, 2))),
+                     _mm_cmpeq_epi32(lhs_block, _mm_shuffle_epi32(rhs_block, _MM_SHUFFLE(2, 1, 0, 3)))));
+    return _mm_movemask_ps(_mm_castsi128_ps(matches));
+}
+#else
+inline uint32_t MatchBlocks(const uint32_t* lhs, const uint32_t* rhs) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        for (size_t j = 0; j < BLOCK_SIZE; ++j) {
+            mask |= static_cast<uint32_t>(lhs[i] == rhs[j]) << i;
+        }
+    }
+    return mask;
+}
+#endif
+
+} // namespace intersection_detail
+
+// Вызывает callback(value) для каждого значения, которое есть в обоих массивах, по возрастанию.
+// Массивы отсортированы по возрастанию и не содержат повторов
+template <typename Callback>
+void ForEachCommonValue(ArrayView<uint32_t> lhs, ArrayView<uint32_t> rhs, Callback callback) {
+    using namespace intersection_detail;
+    if (lhs.size() > rhs.size()) {
+        std::swap(lhs, rhs);
+    }
+    const uint32_t* lhs_it = lhs.begin();
+    const uint32_t* rhs_it = rhs.begin();
+    if (lhs.size() * SEARCH_SIZE_RATIO < rhs.size()) {
+        for (; lhs_it != lhs.end() && rhs_it != rhs.end(); ++lhs_it) {
+            rhs_it = std::lower_bound(rhs_it, rhs.end(), *lhs_it);
+            if (rhs_it != rhs.end() && *rhs_it == *lhs_it) {
+                callback(*lhs_it);
+            }
+        }
+        return;
+    }
+
+    // Блоки по четыре элемента: после сравнения сдвигается блок с меньшим последним элементом,
+    // а при равных последних элементах - оба. Пропущенных совпадений не бывает, так как значения уникальны
+    while (lhs.end() - lhs_it >= static_cast<ptrdiff_t>(BLOCK_SIZE) && rhs.end() - rhs_it >= static_cast<ptrdiff_t>(BLOCK_SIZE)) {
+        for (uint32_t mask = MatchBlocks(lhs_it, rhs_it); mask != 0; mask &= mask - 1) {
+            callback(lhs_it[__builtin_ctz(mask)]);
+        }
+        const uint32_t lhs_last = lhs_it[BLOCK_SIZE - 1];
+        const uint32_t rhs_last = rhs_it[BLOCK_SIZE - 1];
+        if (lhs_last <= rhs_last) {
+            lhs_it += BLOCK_SIZE;
+        }
+        if (rhs_last <= lhs_last) {
+            rhs_it += BLOCK_SIZE;
+        }
+    }
+    while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+        if (*lhs_it < *rhs_it) {
+            ++lhs_it;
+        } else if (*rhs_it < *lhs_it) {
+            ++rhs_it;
+        } else {
+            callback(*lhs_it);
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+}
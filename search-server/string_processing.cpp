@@ -3,23 +3,9 @@
 using namespace std;
 
 vector<string_view> SplitIntoWords(string_view str) {
-    
     vector<string_view> result;
-    
-    int64_t pos = str.find_first_not_of(" ");
-    
-    const int64_t pos_end = str.npos;
-    
-    while (pos != pos_end) {
-        
-        int64_t space = str.find(' ', pos);
-        
-        result.push_back(space == pos_end ? str.substr(pos) : str.substr(pos, space - pos));
-        
-        pos = str.find_first_not_of(" ", space);
-    }
-
+    ForEachWord(str, [&result](string_view word, bool) {
+        result.push_back(word);
+    });
     return result;
 }
-
-
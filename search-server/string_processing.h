@@ -6,12 +6,22 @@
 #include <unordered_set>
 #include <set>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 std::vector<std::string_view> SplitIntoWords(std::string_view str);
 
+template <typename Callback>
+void ForEachWord(std::string_view str, Callback callback);
+
 template <typename StringContainer>
-std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
-    std::set<std::string> non_empty_strings;
+std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
+    std::set<std::string, std::less<>> non_empty_strings;
     for (const auto& str : strings) { 
         if (!str.empty()) {   
             non_empty_strings.insert(str);
@@ -20,3 +30,95 @@ std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings)
     return non_empty_strings;
 }
 
+namespace tokenizer_detail {
+
+// Маски пробелов и управляющих символов (0..31) для блока из BLOCK_SIZE байт
+#if defined(__AVX2__)
+const size_t BLOCK_SIZE = 32;
+
+inline void LoadMasks(const char* block, uint32_t& space_mask, uint32_t& control_mask) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    space_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')));
+    control_mask = _mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), bytes)));
+}
+#elif defined(__SSE2__)
+const size_t BLOCK_SIZE = 16;
+
+inline void LoadMasks(const char* block, uint32_t& space_mask, uint32_t& control_mask) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+    space_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')));
+    control_mask = _mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpgt_epi8(bytes, _mm_set1_epi8(-1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8(' '))));
+}
+#else
+const size_t BLOCK_SIZE = 16;
+
+inline void LoadMasks(const char* block, uint32_t& space_mask, uint32_t& control_mask) {
+    space_mask = 0;
+    control_mask = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        const char c = block[i];
+        space_mask |= static_cast<uint32_t>(c == ' ') << i;
+        control_mask |= static_cast<uint32_t>(c >= '\0' && c < ' ') << i;
+    }
+}
+#endif
+
+inline uint32_t CountTrailingZeros(uint32_t mask) {
+    return __builtin_ctz(mask);
+}
+
+} // namespace tokenizer_detail
+
+// Один проход по тексту: находит слова, разделённые пробелами, и сразу проверяет,
+// нет ли в слове управляющих символов. callback вызывается как callback(word, is_valid)
+template <typename Callback>
+void ForEachWord(std::string_view str, Callback callback) {
+    using namespace tokenizer_detail;
+    const uint32_t full_mask = ~0u >> (32 - BLOCK_SIZE);
+
+    bool in_word = false;
+    bool is_valid = true;
+    size_t word_begin = 0;
+    char tail[BLOCK_SIZE];
+    for (size_t offset = 0; offset < str.size(); offset += BLOCK_SIZE) {
+        const char* block = str.data() + offset;
+        if (str.size() - offset < BLOCK_SIZE) {
+            // последний неполный блок дополняется пробелами, они же завершают последнее слово
+            std::fill(std::begin(tail), std::end(tail), ' ');
+            std::copy(block, str.data() + str.size(), tail);
+            block = tail;
+        }
+        uint32_t space_mask, control_mask;
+        LoadMasks(block, space_mask, control_mask);
+
+        uint32_t pos = 0;
+        while (pos < BLOCK_SIZE) {
+            const uint32_t rest = full_mask >> pos;
+            if (in_word) {
+                const uint32_t spaces = (space_mask >> pos) & rest;
+                const uint32_t length = spaces == 0 ? BLOCK_SIZE - pos : CountTrailingZeros(spaces);
+                const uint32_t word_bits = length == 32 ? ~0u : (1u << length) - 1;
+                is_valid = is_valid && ((control_mask >> pos) & word_bits) == 0;
+                pos += length;
+                if (spaces != 0) {
+                    callback(str.substr(word_begin, offset + pos - word_begin), is_valid);
+                    in_word = false;
+                }
+            } else {
+                const uint32_t letters = ~(space_mask >> pos) & rest;
+                if (letters == 0) {
+                    break;
+                }
+                pos += CountTrailingZeros(letters);
+                word_begin = offset + pos;
+                in_word = true;
+                is_valid = true;
+            }
+        }
+    }
+    if (in_word) {
+        callback(str.substr(word_begin), is_valid);
+    }
+}
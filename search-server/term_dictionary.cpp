@@ -0,0 +1,137 @@
+#include "term_dictionary.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+const TermId TermDictionary::NO_TERM;
+
+TermId TermDictionary::Add(string_view word) {
+    if (const TermId term = Find(word); term != NO_TERM) {
+        return term;
+    }
+    const TermId term = GetTermCount();
+    const string& stored_word = words_.emplace_back(word);
+    ids_.emplace(stored_word, term);
+    word_bytes_ += GetHeapSize(stored_word);
+    return term;
+}
+
+TermId TermDictionary::Find(string_view word) const {
+    if (const TermId term = FindInBase(word); term != NO_TERM) {
+        return term;
+    }
+    auto it = ids_.find(word);
+    return it == ids_.end() ? NO_TERM : it->second;
+}
+
+string_view TermDictionary::GetWord(TermId term) const {
+    if (term < base_term_count_) {
+        return {base_chars_ + base_offsets_[term], base_offsets_[term + 1] - base_offsets_[term]};
+    }
+    return words_[term - base_term_count_];
+}
+
+size_t TermDictionary::GetTermCount() const {
+    return base_term_count_ + words_.size();
+}
+
+size_t TermDictionary::GetMemoryUsage() const {
+    // std::deque хранит строки блоками по 512 байт и держит массив указателей на блоки
+    const size_t words_per_block = max<size_t>(1, 512 / sizeof(string));
+    const size_t block_count = words_.size() / words_per_block + 1;
+    return block_count * GetHeapBlockSize(512) + GetHeapBlockSize((block_count + 2) * sizeof(void*)) + word_bytes_
+        + ids_.size() * GetHashNodeSize<pair<const string_view, TermId>>() + GetHeapBlockSize(ids_.bucket_count() * sizeof(void*));
+}
+
+void TermDictionary::Save(SnapshotWriter& writer) const {
+    const size_t term_count = GetTermCount();
+    string chars;
+    vector<uint64_t> offsets;
+    offsets.reserve(term_count + 1);
+    offsets.push_back(0);
+    for (TermId term = 0; term < term_count; ++term) {
+        chars += GetWord(term);
+        offsets.push_back(chars.size());
+    }
+
+    // открытая адресация с линейным пробированием, заполненность не больше половины
+    size_t table_size = 1;
+    while (table_size < 2 * term_count) {
+        table_size *= 2;
+    }
+    vector<TermId> table(table_size, NO_TERM);
+    for (TermId term = 0; term < term_count; ++term) {
+        const string_view word = GetWord(term);
+        size_t slot = ComputeChecksum(word.data(), word.size()) & (table_size - 1);
+        while (table[slot] != NO_TERM) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        table[slot] = term;
+    }
+
+    writer.WriteSection(SnapshotSection::TERM_CHARS, chars.data(), chars.size());
+    writer.WriteSection(SnapshotSection::TERM_OFFSETS, offsets);
+    writer.WriteSection(SnapshotSection::TERM_HASH_TABLE, table);
+}
+
+void TermDictionary::Load(const SnapshotReader& reader) {
+    const auto [chars, chars_size] = reader.GetSection<char>(SnapshotSection::TERM_CHARS);
+    const auto [offsets, offset_count] = reader.GetSection<uint64_t>(SnapshotSection::TERM_OFFSETS);
+    const auto [table, table_size] = reader.GetSection<TermId>(SnapshotSection::TERM_HASH_TABLE);
+    if (offset_count == 0 || offsets[offset_count - 1] > chars_size || table_size == 0 || (table_size & (table_size - 1)) != 0) {
+        throw invalid_argument("Snapshot term dictionary is corrupted"s);
+    }
+    base_chars_ = chars;
+    base_offsets_ = offsets;
+    base_term_count_ = offset_count - 1;
+    base_table_ = table;
+    base_table_size_ = table_size;
+    words_.clear();
+    ids_.clear();
+    word_bytes_ = 0;
+}
+
+void TermDictionary::Validate(const SnapshotReader& reader) {
+    const auto [chars, chars_size] = reader.GetSection<char>(SnapshotSection::TERM_CHARS);
+    const auto [offsets, offset_count] = reader.GetSection<uint64_t>(SnapshotSection::TERM_OFFSETS);
+    const auto [table, table_size] = reader.GetSection<TermId>(SnapshotSection::TERM_HASH_TABLE);
+    if (offset_count == 0 || offsets[0] != 0 || offsets[offset_count - 1] > chars_size) {
+        throw invalid_argument("Snapshot term dictionary is corrupted"s);
+    }
+    const size_t term_count = offset_count - 1;
+    for (size_t term = 0; term < term_count; ++term) {
+        if (offsets[term] > offsets[term + 1]) {
+            throw invalid_argument("Snapshot term dictionary is corrupted"s);
+        }
+    }
+    // поиск идёт до пустой ячейки, поэтому хотя бы одна ячейка должна быть пустой
+    size_t empty_slot_count = 0;
+    for (size_t slot = 0; slot < table_size; ++slot) {
+        if (table[slot] == NO_TERM) {
+            ++empty_slot_count;
+        } else if (table[slot] >= term_count) {
+            throw invalid_argument("Snapshot term dictionary is corrupted"s);
+        }
+    }
+    if (empty_slot_count == 0) {
+        throw invalid_argument("Snapshot term dictionary is corrupted"s);
+    }
+}
+
+TermId TermDictionary::FindInBase(string_view word) const {
+    if (base_table_size_ == 0) {
+        return NO_TERM;
+    }
+    size_t slot = ComputeChecksum(word.data(), word.size()) & (base_table_size_ - 1);
+    while (base_table_[slot] != NO_TERM) {
+        if (GetWord(base_table_[slot]) == word) {
+            return base_table_[slot];
+        }
+        slot = (slot + 1) & (base_table_size_ - 1);
+    }
+    return NO_TERM;
+}
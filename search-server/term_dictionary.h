@@ -0,0 +1,54 @@
+#pragma once
+
+#include "snapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using TermId = uint32_t;
+
+// Присваивает каждому слову компактный номер; string_view на слова остаются валидными всё время жизни словаря.
+// После загрузки снимка слова из него ищутся по хеш-таблице прямо в отображённом файле,
+// новые слова хранятся в памяти
+class TermDictionary {
+public:
+    static const TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+    TermId Add(std::string_view word);
+
+    // NO_TERM, если слово не встречалось
+    TermId Find(std::string_view word) const;
+
+    std::string_view GetWord(TermId term) const;
+
+    size_t GetTermCount() const;
+
+    // Память в куче со служебными данными распределителя; слова из снимка в неё не входят
+    size_t GetMemoryUsage() const;
+
+    void Save(SnapshotWriter& writer) const;
+
+    void Load(const SnapshotReader& reader);
+
+    // Проверяет слова и хеш-таблицу снимка, загруженного без проверки контрольных сумм
+    static void Validate(const SnapshotReader& reader);
+
+private:
+    const char* base_chars_ = nullptr;
+    const uint64_t* base_offsets_ = nullptr;
+    size_t base_term_count_ = 0;
+    const TermId* base_table_ = nullptr;
+    size_t base_table_size_ = 0;
+
+    std::deque<std::string> words_;
+    std::unordered_map<std::string_view, TermId> ids_;
+    // символы длинных слов из words_, которые не поместились внутрь std::string
+    size_t word_bytes_ = 0;
+
+    TermId FindInBase(std::string_view word) const;
+};
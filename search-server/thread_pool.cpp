@@ -0,0 +1,127 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Пул и номер работника, которым является текущий поток
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t worker_count) {
+    worker_count = max<size_t>(worker_count, 1);
+    queues_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        queues_.push_back(make_unique<TaskQueue>());
+    }
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.emplace_back([this, i] {
+            RunWorker(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard lock(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetWorkerCount() const {
+    return workers_.size();
+}
+
+size_t ThreadPool::GetIdleWorkerCount() const {
+    return workers_.size() - min(workers_.size(), busy_worker_count_.load());
+}
+
+void ThreadPool::Submit(Task task) {
+    {
+        lock_guard lock(submitted_tasks_.mutex);
+        submitted_tasks_.tasks.push_back(move(task));
+    }
+    ++queued_task_count_;
+    Wake();
+}
+
+void ThreadPool::Push(Task task) {
+    const size_t queue = current_pool == this ? current_worker : next_queue_.fetch_add(1) % queues_.size();
+    {
+        lock_guard lock(queues_[queue]->mutex);
+        queues_[queue]->tasks.push_back(move(task));
+    }
+    ++queued_task_count_;
+    Wake();
+}
+
+void ThreadPool::Wake() {
+    {
+        // без захвата мьютекса работник мог бы проверить счётчик до увеличения и заснуть после уведомления
+        lock_guard lock(sleep_mutex_);
+    }
+    wake_up_.notify_one();
+}
+
+bool ThreadPool::RunPendingTask(size_t worker) {
+    if (queued_task_count_.load() == 0) {
+        return false;
+    }
+    Task task;
+    for (size_t i = 0; i < queues_.size() && !task; ++i) {
+        TaskQueue& queue = *queues_[(worker + i) % queues_.size()];
+        lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        // свою очередь работник разбирает с конца, где лежат самые свежие задачи, а чужие - с начала
+        if (i == 0) {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        lock_guard lock(submitted_tasks_.mutex);
+        if (!submitted_tasks_.tasks.empty()) {
+            task = move(submitted_tasks_.tasks.front());
+            submitted_tasks_.tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    --queued_task_count_;
+    task();
+    return true;
+}
+
+void ThreadPool::RunWorker(size_t worker) {
+    current_pool = this;
+    current_worker = worker;
+    while (true) {
+        ++busy_worker_count_;
+        while (RunPendingTask(worker)) {
+        }
+        --busy_worker_count_;
+
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] {
+            return is_stopping_ || queued_task_count_.load() > 0;
+        });
+        if (is_stopping_ && queued_task_count_.load() == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с собственной очередью помощников ParallelFor у каждого работника. Работник берёт задачи
+// из своей очереди с конца, а когда она пуста - крадёт из начала чужих. Задачи Submit лежат в отдельной
+// общей очереди и выполняются, только когда помощников нет. Поток, вызвавший ParallelFor, обрабатывает
+// индексы своего цикла, но чужих задач не выполняет: посторонняя задача могла бы ждать того, что этот
+// же поток должен сделать после цикла. Вложенные циклы не блокируются, потому что каждый цикл
+// доводит до конца поток, который его вызвал
+class ThreadPool {
+public:
+    // worker_count = 0 заменяется на 1
+    explicit ThreadPool(size_t worker_count);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Дожидается выполнения всех поставленных задач
+    ~ThreadPool();
+
+    size_t GetWorkerCount() const;
+
+    // Работники, которые сейчас не выполняют задач
+    size_t GetIdleWorkerCount() const;
+
+    // Вызывает function(i) для каждого i из [0, count) и возвращается, когда все вызовы завершены.
+    // Индексы раздаются по одному, вызывающий поток тоже их обрабатывает. Первое исключение
+    // из function пробрасывается вызывающему после завершения остальных вызовов
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+    using Task = std::function<void()>;
+
+    // Ставит задачу в общую очередь, не дожидаясь её выполнения. Исключение из задачи завершает программу
+    void Submit(Task task);
+
+private:
+
+    struct alignas(64) TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    TaskQueue submitted_tasks_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_task_count_{0};
+    std::atomic<size_t> busy_worker_count_{0};
+    std::atomic<size_t> next_queue_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_up_;
+    bool is_stopping_ = false;
+
+    // Из работника пула задача попадает в его очередь, из постороннего потока - в очереди по кругу
+    void Push(Task task);
+
+    void Wake();
+
+    // Выполняет одну задачу, если она есть: сначала помощника ParallelFor, затем задачу Submit
+    bool RunPendingTask(size_t worker);
+
+    void RunWorker(size_t worker);
+};
+
+// Выполняет function(i) для i из [0, count) в пуле или, если thread_pool == nullptr, в вызывающем потоке
+template <typename Function>
+void ForEachIndex(ThreadPool* thread_pool, size_t count, Function function) {
+    if (thread_pool != nullptr) {
+        thread_pool->ParallelFor(count, function);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        function(i);
+    }
+}
+
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function) {
+    if (count <= 1) {
+        if (count == 1) {
+            function(0);
+        }
+        return;
+    }
+
+    struct Loop {
+        std::atomic<size_t> next_index{0};
+        std::atomic<size_t> finished_count{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+    // Помощники, начавшие работу после окончания цикла, не получают индексов и не обращаются
+    // к function, поэтому ссылка на неё не переживает вызов
+    const auto loop = std::make_shared<Loop>();
+    const auto run = [loop, count, &function] {
+        size_t finished_count = 0;
+        for (size_t i = loop->next_index.fetch_add(1); i < count; i = loop->next_index.fetch_add(1)) {
+            try {
+                function(i);
+            } catch (...) {
+                std::lock_guard lock(loop->mutex);
+                if (!loop->error) {
+                    loop->error = std::current_exception();
+                }
+            }
+            ++finished_count;
+        }
+        if (finished_count > 0 && loop->finished_count.fetch_add(finished_count) + finished_count == count) {
+            std::lock_guard lock(loop->mutex);
+            loop->finished.notify_all();
+        }
+    };
+
+    const size_t helper_count = std::min(count - 1, workers_.size());
+    for (size_t i = 0; i < helper_count; ++i) {
+        Push(run);
+    }
+    run();
+    // индексов не осталось; ждём вызовы, которые ещё выполняют помощники
+    std::unique_lock lock(loop->mutex);
+    loop->finished.wait(lock, [&loop, count] {
+        return loop->finished_count.load() == count;
+    });
+    if (loop->error) {
+        std::rethrow_exception(loop->error);
+    }
+}
@@ -0,0 +1,74 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    const auto lhs_relevance = llround(lhs.relevance / RELEVANCE_EPSILON);
+    const auto rhs_relevance = llround(rhs.relevance / RELEVANCE_EPSILON);
+    if (lhs_relevance != rhs_relevance) {
+        return lhs_relevance > rhs_relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+TopDocuments::TopDocuments(size_t max_count) : max_count_(max_count) {
+    heap_.reserve(min(max_count_, RESERVED_DOCUMENT_LIMIT));
+}
+
+void TopDocuments::Reset(size_t max_count) {
+    max_count_ = max_count;
+    heap_.clear();
+    heap_.reserve(min(max_count_, RESERVED_DOCUMENT_LIMIT));
+}
+
+void TopDocuments::Add(const Document& document) {
+    // заведомо худшие документы отсекаются без округления релевантностей
+    if (document.relevance < GetMinRelevance() - RELEVANCE_EPSILON) {
+        return;
+    }
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Add(document);
+    }
+}
+
+double TopDocuments::GetMinRelevance() const {
+    if (max_count_ == 0) {
+        return numeric_limits<double>::infinity();
+    }
+    return heap_.size() < max_count_ ? -numeric_limits<double>::infinity() : heap_.front().relevance;
+}
+
+vector<Document> TopDocuments::Extract() {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return move(heap_);
+}
+
+size_t TopDocuments::GetSize() const {
+    return heap_.size();
+}
+
+size_t TopDocuments::Extract(Document* output) {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    copy(heap_.begin(), heap_.end(), output);
+    const size_t count = heap_.size();
+    heap_.clear();
+    return count;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "document.h"
+
+#include <cstddef>
+#include <vector>
+
+// Точность, с которой сравниваются релевантности
+const double RELEVANCE_EPSILON = 1e-6;
+
+// Строгий слабый порядок выдачи: релевантность, округлённая до RELEVANCE_EPSILON, затем рейтинг, затем id.
+// Прежнее сравнение |lhs - rhs| < EPSILON не транзитивно, и результат зависел от порядка обхода
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Хранит не более max_count лучших документов в куче, худший из них - на вершине
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count);
+
+    // Очищает набор, сохраняя выделенную память
+    void Reset(size_t max_count);
+
+    void Add(const Document& document);
+
+    void Merge(const TopDocuments& other);
+
+    // Релевантность худшего из набранных документов; пока набрано меньше max_count - минус бесконечность.
+    // Документ с релевантностью меньше GetMinRelevance() - RELEVANCE_EPSILON в выдачу уже не попадёт
+    double GetMinRelevance() const;
+
+    // Количество набранных документов
+    size_t GetSize() const;
+
+    // Документы в порядке убывания IsMoreRelevant
+    std::vector<Document> Extract();
+
+    // Записывает документы в output в порядке убывания IsMoreRelevant и возвращает их количество
+    size_t Extract(Document* output);
+
+private:
+    // Память резервируется не больше чем на столько документов: при большом max_count запрос
+    // обычно находит лишь несколько документов, и куча растёт по мере надобности
+    static constexpr size_t RESERVED_DOCUMENT_LIMIT = 64;
+
+    size_t max_count_;
+    std::vector<Document> heap_;
+};
@@ -0,0 +1,113 @@
+#include "tracing.h"
+
+using namespace std;
+
+string_view GetTraceName(TraceOperation operation) {
+    switch (operation) {
+        case TraceOperation::FIND_TOP_DOCUMENTS: return "find_top_documents"sv;
+        case TraceOperation::FIND_TOP_DOCUMENTS_BATCH: return "find_top_documents_batch"sv;
+        case TraceOperation::MATCH_DOCUMENT: return "match_document"sv;
+        case TraceOperation::MATCH_DOCUMENTS: return "match_documents"sv;
+        case TraceOperation::ADD_DOCUMENT: return "add_document"sv;
+        case TraceOperation::ADD_DOCUMENTS: return "add_documents"sv;
+        case TraceOperation::REMOVE_DOCUMENTS: return "remove_documents"sv;
+    }
+    return "unknown"sv;
+}
+
+string_view GetTraceName(TraceStage stage) {
+    switch (stage) {
+        case TraceStage::PARSE_QUERY: return "parse_query"sv;
+        case TraceStage::SCORE_TERMS: return "score_terms"sv;
+        case TraceStage::MINUS_WORDS: return "minus_words"sv;
+        case TraceStage::POSTING_SCAN: return "posting_scan"sv;
+        case TraceStage::RANKING: return "ranking"sv;
+        case TraceStage::SPLIT_WORDS: return "split_words"sv;
+        case TraceStage::WRITE_AHEAD_LOG: return "write_ahead_log"sv;
+        case TraceStage::INDEX_UPDATE: return "index_update"sv;
+    }
+    return "unknown"sv;
+}
+
+string_view GetTraceName(TraceCounter counter) {
+    switch (counter) {
+        case TraceCounter::POSTINGS_SCANNED: return "postings_scanned"sv;
+        case TraceCounter::POSTINGS_SKIPPED: return "postings_skipped"sv;
+        case TraceCounter::DOCUMENTS_SCORED: return "documents_scored"sv;
+        case TraceCounter::DOCUMENT_WORDS: return "document_words"sv;
+        case TraceCounter::ALLOCATIONS: return "allocations"sv;
+    }
+    return "unknown"sv;
+}
+
+Tracer& Tracer::GetInstance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::SetCapacity(size_t capacity) {
+    lock_guard lock(mutex_);
+    capacity_ = capacity;
+}
+
+void Tracer::Add(const TraceRecord& record) {
+    lock_guard lock(mutex_);
+    if (records_.size() >= capacity_) {
+        ++dropped_count_;
+        return;
+    }
+    records_.push_back(record);
+}
+
+vector<TraceRecord> Tracer::GetRecords() const {
+    lock_guard lock(mutex_);
+    return records_;
+}
+
+uint64_t Tracer::GetDroppedCount() const {
+    lock_guard lock(mutex_);
+    return dropped_count_;
+}
+
+void Tracer::Clear() {
+    lock_guard lock(mutex_);
+    records_.clear();
+    dropped_count_ = 0;
+}
+
+void Tracer::WriteJsonLines(ostream& output) const {
+    lock_guard lock(mutex_);
+    for (const TraceRecord& record : records_) {
+        output << "{\"operation\":\""sv << GetTraceName(record.operation) << "\",\"duration_ns\":"sv << record.duration.count()
+               << ",\"stages\":{"sv;
+        for (size_t stage = 0; stage < TRACE_STAGE_COUNT; ++stage) {
+            output << (stage == 0 ? ""sv : ","sv) << '"' << GetTraceName(static_cast<TraceStage>(stage)) << "\":"sv
+                   << record.stage_durations[stage].count();
+        }
+        output << "},\"counters\":{"sv;
+        for (size_t counter = 0; counter < TRACE_COUNTER_COUNT; ++counter) {
+            output << (counter == 0 ? ""sv : ","sv) << '"' << GetTraceName(static_cast<TraceCounter>(counter)) << "\":"sv
+                   << record.counters[counter];
+        }
+        output << "}}\n"sv;
+    }
+}
+
+OperationTrace::OperationTrace(TraceOperation operation)
+    : is_outer_(current_trace_record == nullptr) {
+    if (is_outer_) {
+        record_.operation = operation;
+        current_trace_record = &record_;
+        start_time_ = Clock::now();
+    }
+}
+
+OperationTrace::~OperationTrace() {
+    if (!is_outer_) {
+        return;
+    }
+    record_.duration = Clock::now() - start_time_;
+    // запись убирается до передачи: выделения памяти в Tracer::Add не должны попасть в её счётчики
+    current_trace_record = nullptr;
+    Tracer::GetInstance().Add(record_);
+}
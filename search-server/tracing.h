@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// Трассировка этапов запросов и добавления документов. Включается макросом SEARCH_SERVER_TRACING
+// при сборке; без него макросы TRACE_* раскрываются в пустоту и ничего не стоят
+
+enum class TraceOperation {
+    FIND_TOP_DOCUMENTS,
+    FIND_TOP_DOCUMENTS_BATCH,
+    MATCH_DOCUMENT,
+    MATCH_DOCUMENTS,
+    ADD_DOCUMENT,
+    ADD_DOCUMENTS,
+    REMOVE_DOCUMENTS,
+};
+
+enum class TraceStage {
+    PARSE_QUERY,
+    SCORE_TERMS,
+    MINUS_WORDS,
+    // обход постингов плюс-слов, включая поиск постингов у кандидатов при отсечении
+    POSTING_SCAN,
+    // отбор лучших документов и их выгрузка
+    RANKING,
+    SPLIT_WORDS,
+    WRITE_AHEAD_LOG,
+    INDEX_UPDATE,
+};
+
+enum class TraceCounter {
+    POSTINGS_SCANNED,
+    POSTINGS_SKIPPED,
+    DOCUMENTS_SCORED,
+    DOCUMENT_WORDS,
+    // заполняется приложением, например из своего operator new
+    ALLOCATIONS,
+};
+
+const size_t TRACE_STAGE_COUNT = static_cast<size_t>(TraceStage::INDEX_UPDATE) + 1;
+const size_t TRACE_COUNTER_COUNT = static_cast<size_t>(TraceCounter::ALLOCATIONS) + 1;
+
+std::string_view GetTraceName(TraceOperation operation);
+std::string_view GetTraceName(TraceStage stage);
+std::string_view GetTraceName(TraceCounter counter);
+
+struct TraceRecord {
+    TraceOperation operation = TraceOperation::FIND_TOP_DOCUMENTS;
+    std::chrono::nanoseconds duration{0};
+    std::array<std::chrono::nanoseconds, TRACE_STAGE_COUNT> stage_durations{};
+    std::array<uint64_t, TRACE_COUNTER_COUNT> counters{};
+};
+
+// Собирает записи завершённых операций всех потоков. Записи сверх ёмкости не сохраняются, а только считаются
+class Tracer {
+public:
+    static Tracer& GetInstance();
+
+    void SetCapacity(size_t capacity);
+
+    void Add(const TraceRecord& record);
+
+    std::vector<TraceRecord> GetRecords() const;
+
+    uint64_t GetDroppedCount() const;
+
+    void Clear();
+
+    // По JSON-объекту на строку, длительности в наносекундах:
+    // {"operation":"find_top_documents","duration_ns":1234,"stages":{...},"counters":{...}}
+    void WriteJsonLines(std::ostream& output) const;
+
+private:
+    static const size_t DEFAULT_CAPACITY = 1 << 16;
+
+    mutable std::mutex mutex_;
+    std::vector<TraceRecord> records_;
+    size_t capacity_ = DEFAULT_CAPACITY;
+    uint64_t dropped_count_ = 0;
+};
+
+// Запись операции, выполняемой в этом потоке; у работников пула её нет, поэтому выполненные ими
+// части операции в трассу не попадают
+inline thread_local TraceRecord* current_trace_record = nullptr;
+
+// Трасса операции в текущем потоке. Вложенная операция не заводит своей записи: её этапы достаются внешней
+class OperationTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit OperationTrace(TraceOperation operation);
+
+    OperationTrace(const OperationTrace&) = delete;
+    OperationTrace& operator=(const OperationTrace&) = delete;
+
+    ~OperationTrace();
+
+private:
+    TraceRecord record_;
+    bool is_outer_;
+    Clock::time_point start_time_;
+};
+
+// Добавляет время своей жизни к этапу текущей операции. Вложенный этап учёлся бы дважды,
+// поэтому этапы друг в друга не вкладываются
+class StageTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StageTrace(TraceStage stage)
+        : record_(current_trace_record)
+        , stage_(stage) {
+        if (record_ != nullptr) {
+            start_time_ = Clock::now();
+        }
+    }
+
+    StageTrace(const StageTrace&) = delete;
+    StageTrace& operator=(const StageTrace&) = delete;
+
+    ~StageTrace() {
+        if (record_ != nullptr) {
+            record_->stage_durations[static_cast<size_t>(stage_)] += Clock::now() - start_time_;
+        }
+    }
+
+private:
+    TraceRecord* record_;
+    TraceStage stage_;
+    Clock::time_point start_time_;
+};
+
+inline void AddTraceCount(TraceCounter counter, uint64_t value) {
+    if (current_trace_record != nullptr) {
+        current_trace_record->counters[static_cast<size_t>(counter)] += value;
+    }
+}
+
+#ifdef SEARCH_SERVER_TRACING
+#define TRACE_CONCAT_INTERNAL(X, Y) X ## Y
+#define TRACE_CONCAT(X, Y) TRACE_CONCAT_INTERNAL(X, Y)
+#define TRACE_OPERATION(operation) OperationTrace TRACE_CONCAT(operation_trace, __LINE__)(TraceOperation::operation)
+#define TRACE_STAGE(stage) StageTrace TRACE_CONCAT(stage_trace, __LINE__)(TraceStage::stage)
+#define TRACE_COUNT(counter, value) AddTraceCount(TraceCounter::counter, value)
+#else
+#define TRACE_OPERATION(operation)
+#define TRACE_STAGE(stage)
+#define TRACE_COUNT(counter, value)
+#endif
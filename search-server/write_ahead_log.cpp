@@ -0,0 +1,278 @@
+#include "write_ahead_log.h"
+#include "snapshot.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct RecordHeader {
+    uint64_t checksum;
+    uint64_t sequence_number;
+    uint32_t payload_size;
+    LogRecordType type;
+};
+
+uint64_t ComputeRecordChecksum(const RecordHeader& header, const char* payload) {
+    const char* fields = reinterpret_cast<const char*>(&header) + sizeof(header.checksum);
+    return ComputeChecksum(payload, header.payload_size, ComputeChecksum(fields, sizeof(header) - sizeof(header.checksum)));
+}
+
+template <typename T>
+void Put(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool Get(string_view& in, T& value) {
+    if (in.size() < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+void PutDocument(string& out, int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    Put<int32_t>(out, document_id);
+    Put<int32_t>(out, static_cast<int32_t>(status));
+    Put<uint32_t>(out, ratings.size());
+    for (const int rating : ratings) {
+        Put<int32_t>(out, rating);
+    }
+    Put<uint32_t>(out, document.size());
+    out.append(document);
+}
+
+bool GetDocument(string_view& in, NewDocument& document) {
+    int32_t document_id;
+    int32_t status;
+    uint32_t rating_count;
+    if (!Get(in, document_id) || !Get(in, status) || !Get(in, rating_count) || rating_count > in.size() / sizeof(int32_t)) {
+        return false;
+    }
+    document.id = document_id;
+    document.status = static_cast<DocumentStatus>(status);
+    document.ratings.resize(rating_count);
+    for (int& rating : document.ratings) {
+        int32_t value = 0;
+        Get(in, value);
+        rating = value;
+    }
+    uint32_t text_size;
+    if (!Get(in, text_size) || text_size > in.size()) {
+        return false;
+    }
+    document.text = in.substr(0, text_size);
+    in.remove_prefix(text_size);
+    return true;
+}
+
+bool WriteAll(int fd, const string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        const ssize_t written = write(fd, data.data() + offset, data.size() - offset);
+        if (written < 0) {
+            return false;
+        }
+        offset += written;
+    }
+    return true;
+}
+
+} // namespace
+
+
+LogReader::LogReader(const string& path) {
+    ifstream in(path, ios::binary);
+    if (in) {
+        data_.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+}
+
+bool LogReader::Next(LogRecord& record) {
+    RecordHeader header;
+    if (data_.size() - offset_ < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data_.data() + offset_, sizeof(header));
+    const char* payload_data = data_.data() + offset_ + sizeof(header);
+    if (header.payload_size > data_.size() - offset_ - sizeof(header)
+        || ComputeRecordChecksum(header, payload_data) != header.checksum) {
+        return false;
+    }
+
+    string_view payload(payload_data, header.payload_size);
+    record.sequence_number = header.sequence_number;
+    record.type = header.type;
+    if (header.type == LogRecordType::ADD_DOCUMENTS) {
+        uint32_t document_count;
+        if (!Get(payload, document_count)) {
+            return false;
+        }
+        record.documents.resize(document_count);
+        for (NewDocument& document : record.documents) {
+            if (!GetDocument(payload, document)) {
+                return false;
+            }
+        }
+    } else if (header.type == LogRecordType::REMOVE_DOCUMENT) {
+        int32_t document_id;
+        if (!Get(payload, document_id)) {
+            return false;
+        }
+        record.document_id = document_id;
+    } else if (header.type == LogRecordType::REMOVE_DOCUMENTS) {
+        uint32_t document_count;
+        if (!Get(payload, document_count) || document_count > payload.size() / sizeof(int32_t)) {
+            return false;
+        }
+        record.document_ids.resize(document_count);
+        for (int& document_id : record.document_ids) {
+            int32_t value = 0;
+            Get(payload, value);
+            document_id = value;
+        }
+    } else {
+        return false;
+    }
+    offset_ += sizeof(header) + header.payload_size;
+    return true;
+}
+
+size_t LogReader::GetValidSize() const {
+    return offset_;
+}
+
+
+WriteAheadLog::WriteAheadLog(const string& path, size_t valid_size, uint64_t last_sequence_number, size_t sync_record_count)
+    : sync_record_count_(sync_record_count)
+    , last_sequence_number_(last_sequence_number)
+    , written_sequence_number_(last_sequence_number)
+    , synced_sequence_number_(last_sequence_number) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        throw runtime_error("Cannot open write-ahead log "s + path);
+    }
+    if (ftruncate(fd_, valid_size) != 0) {
+        close(fd_);
+        throw runtime_error("Cannot truncate write-ahead log "s + path);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    try {
+        Sync();
+    } catch (...) {
+    }
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::AppendAddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    unique_lock lock(mutex_);
+    const size_t header_offset = BeginRecord();
+    Put<uint32_t>(pending_, 1);
+    PutDocument(pending_, document_id, document, status, ratings);
+    return EndRecord(lock, header_offset, LogRecordType::ADD_DOCUMENTS);
+}
+
+uint64_t WriteAheadLog::AppendAddDocuments(const vector<NewDocument>& documents) {
+    // пакет пишется одной записью, поэтому после сбоя он восстанавливается целиком или не восстанавливается вовсе
+    unique_lock lock(mutex_);
+    const size_t header_offset = BeginRecord();
+    Put<uint32_t>(pending_, documents.size());
+    for (const NewDocument& document : documents) {
+        PutDocument(pending_, document.id, document.text, document.status, document.ratings);
+    }
+    return EndRecord(lock, header_offset, LogRecordType::ADD_DOCUMENTS);
+}
+
+uint64_t WriteAheadLog::AppendRemoveDocument(int document_id) {
+    unique_lock lock(mutex_);
+    const size_t header_offset = BeginRecord();
+    Put<int32_t>(pending_, document_id);
+    return EndRecord(lock, header_offset, LogRecordType::REMOVE_DOCUMENT);
+}
+
+uint64_t WriteAheadLog::AppendRemoveDocuments(const vector<int>& document_ids) {
+    unique_lock lock(mutex_);
+    const size_t header_offset = BeginRecord();
+    Put<uint32_t>(pending_, document_ids.size());
+    for (const int document_id : document_ids) {
+        Put<int32_t>(pending_, document_id);
+    }
+    return EndRecord(lock, header_offset, LogRecordType::REMOVE_DOCUMENTS);
+}
+
+void WriteAheadLog::Sync() {
+    unique_lock lock(mutex_);
+    WriteOut(lock, last_sequence_number_, true);
+}
+
+void WriteAheadLog::Truncate() {
+    unique_lock lock(mutex_);
+    written_.wait(lock, [this] { return !is_writing_; });
+    pending_.clear();
+    // номера записей продолжают расти, поэтому старые записи, пережившие сбой до обрезки, при восстановлении пропускаются
+    if (ftruncate(fd_, 0) != 0) {
+        throw runtime_error("Cannot truncate write-ahead log"s);
+    }
+    written_sequence_number_ = last_sequence_number_;
+    synced_sequence_number_ = last_sequence_number_;
+}
+
+size_t WriteAheadLog::BeginRecord() {
+    const size_t header_offset = pending_.size();
+    pending_.resize(header_offset + sizeof(RecordHeader));
+    return header_offset;
+}
+
+uint64_t WriteAheadLog::EndRecord(unique_lock<mutex>& lock, size_t header_offset, LogRecordType type) {
+    RecordHeader header;
+    header.sequence_number = ++last_sequence_number_;
+    header.payload_size = pending_.size() - header_offset - sizeof(header);
+    header.type = type;
+    header.checksum = ComputeRecordChecksum(header, pending_.data() + header_offset + sizeof(header));
+    memcpy(pending_.data() + header_offset, &header, sizeof(header));
+
+    const uint64_t sequence_number = last_sequence_number_;
+    if (sync_record_count_ > 0 && sequence_number - synced_sequence_number_ >= sync_record_count_) {
+        WriteOut(lock, sequence_number, true);
+    } else if (pending_.size() >= BUFFER_WRITE_SIZE) {
+        WriteOut(lock, sequence_number, false);
+    }
+    return sequence_number;
+}
+
+void WriteAheadLog::WriteOut(unique_lock<mutex>& lock, uint64_t sequence_number, bool sync) {
+    while (written_sequence_number_ < sequence_number || (sync && synced_sequence_number_ < sequence_number)) {
+        if (is_writing_) {
+            written_.wait(lock);
+            continue;
+        }
+        // поток пишет всё накопленное, в том числе записи других потоков; они дождутся его fsync
+        is_writing_ = true;
+        swap(pending_, writing_buffer_);
+        const uint64_t target_sequence_number = last_sequence_number_;
+        lock.unlock();
+        const bool is_written = WriteAll(fd_, writing_buffer_) && (!sync || fdatasync(fd_) == 0);
+        writing_buffer_.clear();
+        lock.lock();
+        is_writing_ = false;
+        written_.notify_all();
+        if (!is_written) {
+            throw runtime_error("Cannot write to write-ahead log"s);
+        }
+        written_sequence_number_ = target_sequence_number;
+        if (sync) {
+            synced_sequence_number_ = target_sequence_number;
+        }
+    }
+}
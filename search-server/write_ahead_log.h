@@ -0,0 +1,90 @@
+#pragma once
+
+#include "document.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class LogRecordType : uint32_t {
+    ADD_DOCUMENTS,
+    REMOVE_DOCUMENT,
+    REMOVE_DOCUMENTS,
+};
+
+struct LogRecord {
+    uint64_t sequence_number = 0;
+    LogRecordType type = LogRecordType::ADD_DOCUMENTS;
+    // тексты документов указывают в буфер LogReader
+    std::vector<NewDocument> documents;
+    int document_id = 0;
+    std::vector<int> document_ids;
+};
+
+// Читает журнал до первой недописанной или повреждённой записи: такой хвост остаётся после сбоя во время записи
+class LogReader {
+public:
+    // Отсутствующий файл читается как пустой журнал
+    explicit LogReader(const std::string& path);
+
+    bool Next(LogRecord& record);
+
+    // Размер прочитанной корректной части журнала
+    size_t GetValidSize() const;
+
+private:
+    std::string data_;
+    size_t offset_ = 0;
+};
+
+// Журнал упреждающей записи. Записи копятся в буфере и попадают в файл одним write,
+// fsync выполняется после каждых sync_record_count записей (0 - только в Sync и при закрытии).
+// Потоки, одновременно ждущие синхронизации, обслуживаются одним fsync
+class WriteAheadLog {
+public:
+    // Файл обрезается до valid_size, новые записи получают номера начиная с last_sequence_number + 1
+    WriteAheadLog(const std::string& path, size_t valid_size, uint64_t last_sequence_number, size_t sync_record_count);
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog();
+
+    // Возвращают номер записи
+    uint64_t AppendAddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    uint64_t AppendAddDocuments(const std::vector<NewDocument>& documents);
+    uint64_t AppendRemoveDocument(int document_id);
+    uint64_t AppendRemoveDocuments(const std::vector<int>& document_ids);
+
+    // Дожидается, пока все добавленные записи окажутся на диске
+    void Sync();
+
+    // Удаляет все записи, когда они уже сохранены в снимке
+    void Truncate();
+
+private:
+    static const size_t BUFFER_WRITE_SIZE = 1 << 20;
+
+    int fd_ = -1;
+    size_t sync_record_count_;
+
+    std::mutex mutex_;
+    std::condition_variable written_;
+    std::string pending_;
+    std::string writing_buffer_;
+    bool is_writing_ = false;
+    uint64_t last_sequence_number_;
+    uint64_t written_sequence_number_;
+    uint64_t synced_sequence_number_;
+
+    // Резервирует место под заголовок записи в pending_ и возвращает его смещение
+    size_t BeginRecord();
+    uint64_t EndRecord(std::unique_lock<std::mutex>& lock, size_t header_offset, LogRecordType type);
+
+    // Пишет буфер в файл, пока запись sequence_number не окажется в нём (и на диске, если sync)
+    void WriteOut(std::unique_lock<std::mutex>& lock, uint64_t sequence_number, bool sync);
+};